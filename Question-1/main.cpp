@@ -1,12 +1,30 @@
 #include <iostream>
 #include <vector>
+#include <queue>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using std::cout;
 using std::endl;
 
+typedef __int128 int128;
+
 // A point in 2D space
 struct Point
 { int x, y; };
@@ -18,21 +36,384 @@ struct Line
     Line(Point p1, Point p2) : p1(p1), p2(p2) {}
 };
 
-// Line Events
-struct Event
+/*
+    Lines held either in a vector or in a memory mapped binary line
+    file. The sweeps only read the lines, so both are used the same
+    way and a mapped file is swept with no parse step.
+                                                                    */
+class LineArray
+{
+    std::vector<Line> owned;
+    const Line *lines = nullptr;
+    size_t count = 0;
+
+    // the mapped file, if any
+    void *mapping = nullptr;
+    size_t mapped = 0;
+
+public:
+    LineArray(std::vector<Line> &&line_segments)
+        : owned(std::move(line_segments)), lines(owned.data()), count(owned.size()) {}
+    LineArray(void *mapping, size_t mapped, const Line *lines, size_t count)
+        : lines(lines), count(count), mapping(mapping), mapped(mapped) {}
+    LineArray(LineArray &&other);
+    LineArray(const LineArray &) = delete;
+    ~LineArray() { if (mapping) munmap(mapping, mapped); }
+
+    size_t size() const { return count; }
+    const Line &operator[](size_t i) const { return lines[i]; }
+    const Line *begin() const { return lines; }
+    const Line *end() const { return lines + count; }
+};
+
+static_assert(sizeof(Line) == 4 * sizeof(int32_t), "lines are mapped from binary files");
+
+// Header of a binary line file, followed by count lines of four 32 bit integers
+struct LineFileHeader
+{
+    char magic[4];    // "LSEG"
+    uint32_t version; // 1
+    uint64_t count;   // number of lines
+};
+
+// x coordinates are stored with the sign bit flipped so they sort as unsigned
+unsigned int bias(int value) { return (unsigned int)value ^ 0x80000000u; }
+int unbias(unsigned int value) { return (int)(value ^ 0x80000000u); }
+
+/*
+    Line events stored as a structure of arrays. The high 32 bits
+    of each key hold the biased x coordinate and the low 32 bits
+    the order of events sharing that x, so sorting the keys sorts
+    the events. The reference sweep orders by y rank and then
+    is_left, the counting sweeps by event type:
+        0 = horizontal starts, 1 = vertical, 2 = horizontal ends
+                                                                    */
+struct EventList
+{
+    std::vector<unsigned long long> key; // sort key of each event
+    std::vector<unsigned int> line;      // index of the line of each event
+
+    void push(int x, unsigned int order, int index)
+    {
+        key.push_back((unsigned long long)bias(x) << 32 | order);
+        line.push_back(index);
+    }
+
+    int size() const { return key.size(); }
+    int x(int i) const { return unbias(key[i] >> 32); }
+    unsigned int order(int i) const { return (unsigned int)key[i]; }
+};
+
+// A point with rational coordinates (x / d, y / d) where d > 0
+struct RationalPoint
+{
+    int128 x, y, d;
+    RationalPoint(int128 x, int128 y, int128 d = 1) : x(x), y(y), d(d) {}
+    bool operator<(const RationalPoint &rhs) const; // sorts by x and then y
+    bool operator==(const RationalPoint &rhs) const;
+};
+
+/*
+    Orders the active lines of the Bentley-Ottmann sweep just after
+    the current event point. Lines below the point come first, then
+    the lines through it by slope, then the lines above it. The index
+    -1 stands for the event point itself, so lower_bound(-1) finds
+    the first line through or above it.
+                                                                    */
+struct StatusOrder
+{
+    const LineArray *line_segments;
+    const RationalPoint *point; // the current event point
+
+    // -1 if the line passes below the event point, 0 through it and 1 above it
+    int side(int line) const;
+    bool operator()(int lhs, int rhs) const;
+};
+
+// A line lying on a shared x (vertical) or y (horizontal) value
+struct Span
+{
+    bool vertical;  // orientation of the line
+    int at;         // the shared x or y value
+    int start, end; // extent of the line along the other axis
+    int line;       // index of the line in the vector of lines
+    bool operator<(const Span &rhs) const
+    {
+        return std::tie(vertical, at, start, end, line) <
+               std::tie(rhs.vertical, rhs.at, rhs.start, rhs.end, rhs.line);
+    }
+};
+
+// An intersection between two lines
+struct Intersection
+{
+    int line1, line2;    // indices of the lines, line1 < line2
+    RationalPoint point; // a point shared by both lines
+};
+
+/*
+    Buffered writer that streams intersections as "line1 line2 x y".
+    Coordinates that are not whole numbers are written as fractions
+    in lowest terms, such as 7/2. Query results are written as one
+    or two numbers per row.
+                                                                    */
+class IntersectionWriter
+{
+    FILE *file;
+    std::vector<char> buffer;
+    size_t used = 0;
+
+    // append an integer to the buffer
+    void put(int128 value, char end);
+
+    // append num / den in lowest terms to the buffer
+    void put(int128 num, int128 den, char end);
+
+public:
+    IntersectionWriter(const char *filename);
+    ~IntersectionWriter();
+
+    // write one intersection
+    void operator()(const Intersection &hit);
+
+    // write a row of one or two numbers
+    void operator()(long long first);
+    void operator()(long long first, long long second);
+
+    // write the buffer to the file
+    void flush();
+};
+
+// An axis aligned window with x1 <= x2 and y1 <= y2
+struct Window
+{ int x1, y1, x2, y2; };
+
+/*
+    Merge sort tree over the lines of one orientation sorted by their
+    shared x (vertical) or y (horizontal) value. Every node keeps the
+    extents of its lines sorted by start, their ends sorted on their
+    own and a max tree over the ends in start order. Each array holds
+    all the nodes of one depth side by side.
+                                                                    */
+class RangeTree
+{
+    std::vector<int> keys;                  // sorted shared value of each line
+    std::vector<std::vector<int>> starts;   // starts of each node, sorted
+    std::vector<std::vector<int>> stops;    // ends in the same order as starts
+    std::vector<std::vector<int>> lines;    // lines in the same order as starts
+    std::vector<std::vector<int>> ends;     // ends of each node, sorted
+    std::vector<std::vector<int>> max_ends; // max tree over stops of each node
+
+    // node of the max tree covering [lo, hi] of a node's entries
+    static int max_node(int lo, int hi) { return (lo + hi) | (lo != hi); }
+
+    void build(int depth, int l, int r, const std::vector<Span> &spans);
+    int build_max(int depth, int l, int lo, int hi);
+    long long count(int depth, int l, int r, int pl, int pr, int a, int b) const;
+    template<typename Report>
+    long long report(int depth, int l, int r, int pl, int pr, int a, int b,
+                     Report &report) const;
+    template<typename Report>
+    long long report_node(int depth, int l, int lo, int hi, int p, int a,
+                          Report &report) const;
+
+public:
+    RangeTree(const LineArray &line_segments, bool vertical);
+
+    // count the lines with a shared value in [key1, key2] and an extent overlapping [a, b]
+    long long count(int key1, int key2, int a, int b) const;
+
+    // pass the index of each of those lines to report
+    template<typename Report>
+    long long report(int key1, int key2, int a, int b, Report &report) const;
+};
+
+/*
+    Index over a fixed set of horizontal and vertical lines that counts
+    the lines crossing a window in O(log^2 n) and reports them in
+    O(log^2 n + k log n), using O(n log n) memory. A probe line is a
+    window of zero width or height.
+                                                                    */
+class SegmentIndex
+{
+    RangeTree vertical, horizontal;
+
+public:
+    SegmentIndex(const LineArray &line_segments)
+        : vertical(line_segments, true), horizontal(line_segments, false) {}
+
+    long long count(const Window &window) const
+    {
+        return vertical.count(window.x1, window.x2, window.y1, window.y2) +
+               horizontal.count(window.y1, window.y2, window.x1, window.x2);
+    }
+
+    template<typename Report>
+    long long report(const Window &window, Report &report) const
+    {
+        return vertical.report(window.x1, window.x2, window.y1, window.y2, report) +
+               horizontal.report(window.y1, window.y2, window.x1, window.x2, report);
+    }
+};
+
+// Order statistic treaps sharing one pool of nodes, 0 is the empty treap
+class TreapPool
+{
+    struct Node
+    {
+        int key;
+        unsigned priority;
+        int size, left, right;
+    };
+
+    std::vector<Node> nodes = std::vector<Node>(1, Node({0, 0, 0, 0, 0}));
+    std::vector<int> unused;
+    unsigned seed = 2463534242u;
+
+    void update(int t) { nodes[t].size = 1 + nodes[nodes[t].left].size + nodes[nodes[t].right].size; }
+    void split(int t, int key, bool equal_left, int &left, int &right);
+    int merge(int left, int right);
+
+public:
+    // return the new root after adding or removing one copy of key
+    int insert(int root, int key);
+    int erase(int root, int key);
+
+    // return the number of keys <= key
+    int count(int root, int key) const;
+};
+
+/*
+    Counts (key, value) pairs with key and value below a bound while
+    pairs are added and removed. It is a Fenwick tree over the whole
+    32 bit key range, whose nodes are created only when used, and
+    each node is a treap of the values below it. Every operation is
+    O(log U log n) where U = 2^32.
+                                                                    */
+class DominanceCounter
+{
+    TreapPool pool;
+    std::unordered_map<unsigned long long, int> roots;
+
+public:
+    void insert(int key, int value);
+    void erase(int key, int value);
+
+    // count the pairs with key <= key and value <= value
+    long long count(int key, int value) const;
+
+    // count the pairs with key in [key1, key2] and value <= value
+    long long count(int key1, int key2, int value) const;
+};
+
+/*
+    A set of horizontal and vertical lines that keeps its number of
+    intersecting pairs up to date. Each orientation keeps the start
+    and the end of every line against its shared value, so the lines
+    crossing a window are those starting by its far edge minus those
+    ending before its near edge, as in RangeTree. An insert or erase
+    adds or removes the lines crossing just the changed line.
+                                                                    */
+class DynamicLineSet
+{
+    DominanceCounter starts[2], ends[2]; // verticals keyed by x, then horizontals by y
+    std::map<std::tuple<int, int, int, int>, int> present;
+    long long total = 0;
+
+public:
+    // count the lines in the set crossing the window
+    long long crossings(const Window &window) const;
+
+    void insert(const Line &line);
+
+    // return false if the line is not in the set
+    bool erase(const Line &line);
+
+    // the number of intersecting pairs in the set
+    long long count() const { return total; }
+};
+
+// Fenwick tree counting the active horizontal lines at each compressed y
+struct Fenwick
 {
-    int x, y;     // points of a line
-    Line line;    // the line of above points
-    bool is_left; // true if start of line
-    Event(int x, int y, Line line, bool is_left) : x(x), y(y), line(line), is_left(is_left) {}
+    std::vector<int> tree;
+    Fenwick(int n) : tree(n + 1, 0) {}
+
+    // add (index, count) pairs to a tree that has not been built yet
+    void seed(const std::vector<std::pair<int, int>> &counts)
+    {
+        for (auto &count : counts)
+            tree[count.first + 1] += count.second;
+    }
+
+    // turn the seeded counts into a tree in O(n)
+    void build()
+    {
+        for (int i = 1; i < (int)tree.size(); i++)
+            if (i + (i & -i) < (int)tree.size())
+                tree[i + (i & -i)] += tree[i];
+    }
+
+    // add delta to the count at index i
+    void add(int i, int delta)
+    {
+        for (i++; i < (int)tree.size(); i += i & -i)
+            tree[i] += delta;
+    }
+
+    // return the sum of the counts in [0, i)
+    int prefix(int i) const
+    {
+        int sum = 0;
+        for (; i > 0; i -= i & -i)
+            sum += tree[i];
+        return sum;
+    }
+
+    // return the sum of the counts in [lo, hi)
+    int range(int lo, int hi) const { return prefix(hi) - prefix(lo); }
 };
 
-std::vector<Event> readfile(const char *filename);
-int sweep_line(std::vector<Event> line_events);
-bool event_sort(const Event &lhs, const Event &rhs);
+LineArray loadfile(const char *filename);
+std::vector<Line> readfile(const char *filename);
+void writefile(const char *filename, const LineArray &line_segments);
+std::vector<Window> readwindows(const char *filename);
+void run_updates(const char *filename, DynamicLineSet &line_set);
+std::vector<long long> count_queries(const SegmentIndex &index,
+                                     const std::vector<Window> &windows, int threads);
+Line normalise(int x1, int y1, int x2, int y2);
+EventList build_events(const LineArray &line_segments);
+EventList build_sweep_events(const LineArray &line_segments, int threads = 1);
+std::vector<Span> build_spans(const LineArray &line_segments, int threads = 1);
+long long sweep_line(const EventList &line_events, const LineArray &line_segments);
+long long sweep_count(const LineArray &line_segments);
+long long sweep_parallel(const LineArray &line_segments, int threads);
+long long collinear_overlaps(const LineArray &line_segments, int threads = 1);
+long long collinear_range(const std::vector<Span> &spans, int begin, int end);
+template<typename Report>
+long long sweep_report(const LineArray &line_segments, Report &report);
+template<typename Report>
+long long collinear_report(const LineArray &line_segments, Report &report);
+template<typename Report>
+long long bentley_ottmann(const LineArray &line_segments, Report *report);
+void find_event(const LineArray &line_segments, int l1, int l2,
+                const RationalPoint &point, std::map<RationalPoint, std::vector<int>> &queue);
+bool direction_sort(const Line &l1, const Line &l2);
+int compare_fractions(int128 a, int128 b, int128 c, int128 d);
+int128 floor_div(int128 a, int128 b);
+int128 gcd(int128 a, int128 b);
+void radix_sort(EventList &events, int threads = 1);
+template<typename Task>
+void parallel_for(int tasks, int threads, Task task);
+template<typename T, typename Compare>
+void parallel_sort(std::vector<T> &items, Compare compare, int threads);
 int intersections(const Line &l1, const Line &l2);
-int ccw(const Point &p, const Point &q, const Point &r) // counter clockwise algorithm
-{ return (q.x - p.x) * (r.y - p.y) - (r.x - p.x) * (q.y - p.y); }
+int128 ccw(const Point &p, const Point &q, const Point &r) // counter clockwise algorithm
+{ return (int128)(q.x - (long long)p.x) * (r.y - (long long)p.y) -
+         (int128)(r.x - (long long)p.x) * (q.y - (long long)p.y); }
+int sign(int128 value) { return (value > 0) - (value < 0); }
+bool is_vertical(const Line &l) { return l.p1.x == l.p2.x; } // points count as vertical
+bool is_horizontal(const Line &l) { return l.p1.y == l.p2.y && l.p1.x != l.p2.x; }
 
 int main(int argc, char **argv)
 {
@@ -42,13 +423,158 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    /*
+        The Fenwick tree sweep is used by default. Passing
+        --reference runs the original ccw sweep instead and
+        --check runs both and fails if they disagree.
+        --report streams every intersection to a file and
+        --threads splits the sweep into slabs across threads.
+        --convert writes the lines to a binary line file.
+        --query and --query-report index the lines and answer
+        each window in a file of queries.
+        --update applies a file of inserts and erases to the
+        lines, keeping the intersection count up to date.
+        Files with lines that are not horizontal nor vertical
+        use the Bentley-Ottmann sweep instead.
+                                                            */
+    bool reference = argc > 2 && !strcmp(argv[2], "--reference");
+    bool check = argc > 2 && !strcmp(argv[2], "--check");
+    bool report = argc > 2 && !strcmp(argv[2], "--report");
+    bool convert = argc > 2 && !strcmp(argv[2], "--convert");
+    bool query = argc > 2 && !strcmp(argv[2], "--query");
+    bool query_report = argc > 2 && !strcmp(argv[2], "--query-report");
+    bool update = argc > 2 && !strcmp(argv[2], "--update");
+    int threads = argc > 2 && !strcmp(argv[2], "--threads")
+                  ? (argc > 3 ? atoi(argv[3]) : 0) : 1;
+
+    if ((report || convert || query || update) && argc < 4)
+    { // ensure output filename is passed
+        cout << "ERROR! Expected filename after " << argv[2] << endl;
+        exit(1);
+    }
+
+    if (query_report && argc < 5)
+    { // ensure query and output filenames are passed
+        cout << "ERROR! Expected query and output filenames after " << argv[2] << endl;
+        exit(1);
+    }
+
+    if (threads < 1)
+    { // ensure a usable thread count is passed
+        cout << "ERROR! Expected a thread count of at least 1 after --threads" << endl;
+        exit(1);
+    }
+
     auto start = std::chrono::high_resolution_clock::now();
 
     // read in data points
-    std::vector<Event> line_events = move(readfile(argv[1]));
+    LineArray line_segments = loadfile(argv[1]);
+
+    if (convert)
+    { // save the lines as a binary line file
+
+        writefile(argv[3], line_segments);
+        cout << "Wrote " << line_segments.size() << " lines to " << argv[3] << endl;
+        return 0;
+    }
+
+    bool orthogonal = std::all_of(line_segments.begin(), line_segments.end(),
+                                  [](const Line &l) { return is_vertical(l) || is_horizontal(l); });
+
+    if ((query || query_report || update) && !orthogonal)
+    { // the indexes only hold horizontal and vertical lines
+        cout << "ERROR! " << argv[2] << " needs only horizontal and vertical lines" << endl;
+        exit(1);
+    }
+
+    if (update)
+    { // load the lines into a dynamic set and apply the updates
+
+        DynamicLineSet line_set;
+        for (auto &line : line_segments)
+            line_set.insert(line);
+
+        cout << "File: " << argv[1] << endl << "Contains " << line_set.count()
+             << " intersections" << endl;
+
+        run_updates(argv[3], line_set);
+
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast
+                        <std::chrono::microseconds> (stop - start).count();
+
+        cout << "Updates took " << duration << " microseconds" << endl;
+        return 0;
+    }
+
+    if (query || query_report)
+    { // answer every window in the query file against an index of the lines
+
+        SegmentIndex index(line_segments);
+        std::vector<Window> windows = readwindows(argv[3]);
+
+        if (query)
+        { // write the count of each window in order
+
+            IntersectionWriter writer("-");
+            for (auto count : count_queries(index, windows, std::thread::hardware_concurrency()))
+                writer(count);
+        }
+
+        else
+        { // write every (window, line) pair
+
+            IntersectionWriter writer(argv[4]);
+            for (int i = 0; i < (int)windows.size(); i++)
+            {
+                auto write = [&](int line) { writer(i, line); };
+                index.report(windows[i], write);
+            }
+        }
+
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast
+                        <std::chrono::microseconds> (stop - start).count();
+
+        cout << "Answered " << windows.size() << " queries against "
+             << line_segments.size() << " lines and took " << duration
+             << " microseconds" << endl;
+        return 0;
+    }
 
     // Perform sweep line algorithm
-    int count = sweep_line(line_events);
+    long long count = 0;
+    if (report)
+    { // write each intersection as it is found
+
+        IntersectionWriter writer(argv[3]);
+        count = orthogonal ? sweep_report(line_segments, writer)
+                           : bentley_ottmann(line_segments, &writer);
+    }
+
+    else if (reference)
+        count = sweep_line(build_events(line_segments), line_segments);
+
+    else if (!orthogonal)
+        count = bentley_ottmann<IntersectionWriter>(line_segments, nullptr);
+
+    else if (threads > 1)
+        count = sweep_parallel(line_segments, threads);
+
+    else
+        count = sweep_count(line_segments);
+
+    if (check)
+    { // compare against the ccw reference sweep
+
+        long long expected = sweep_line(build_events(line_segments), line_segments);
+        if (count != expected)
+        {
+            cout << "ERROR! Sweep counted " << count << " intersections but "
+                 << "the reference counted " << expected << endl;
+            exit(1);
+        }
+    }
 
     auto stop = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast
@@ -62,141 +588,1562 @@ int main(int argc, char **argv)
     return 0;
 }
 
-std::vector<Event> readfile(const char *filename)
+LineArray loadfile(const char *filename)
+{ /*
+     This function maps the file into memory. A binary line
+     file is used in place, anything else is parsed as text
+     by readfile.
+                                                         */
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0)
+    { // ensure the file can be read
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
+
+    LineFileHeader header;
+    size_t size = info.st_size;
+    if (size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, "LSEG", 4))
+    { // not a binary line file
+        close(fd);
+        return LineArray(readfile(filename));
+    }
+
+    if (header.version != 1 || (size - sizeof(header)) / sizeof(Line) != header.count)
+    { // ensure the header matches the file
+        cout << "ERROR! " << filename << " is not a valid binary line file" << endl;
+        exit(1);
+    }
+
+    void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        cout << "ERROR! Could not map " << filename << endl;
+        exit(1);
+    }
+
+    // the sweeps read the lines in order so let the kernel read ahead
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    return LineArray(mapping, size, (const Line *)((char *)mapping + sizeof(header)),
+                     header.count);
+}
+
+std::vector<Line> readfile(const char *filename)
 { /*
      This function loads all data from the text file
-     to a vector of Lines which is sorted based on
-     x and y value. It then loads these lines into
-     a vector of events and initialises their values.
-     It sorts this vector of events before returning.
+     to a vector of Lines. The file is memory mapped and
+     the integers are parsed straight from the mapping,
+     so no line or stream is ever copied.
                                                          */
 
     // vector of lines
     std::vector<Line> line_segments;
-    // all line events (innactive/active)
-    std::vector<Event> line_events;
 
-    std::ifstream file(filename);
-    std::string line;
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0)
+    { // ensure the file can be read
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
 
-    while (std::getline(file, line))
-    { // read points inputed as p1.x p1.y p2.x p2.y
+    size_t size = info.st_size;
+    if (size == 0)
+    { // nothing to map
+        close(fd);
+        return line_segments;
+    }
 
-        std::stringstream linestream(line);
-        int x1, y1, x2, y2;
-        linestream >> x1 >> y1 >> x2 >> y2;
+    const char *text = (const char *)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        cout << "ERROR! Could not map " << filename << endl;
+        exit(1);
+    }
+    madvise((void *)text, size, MADV_SEQUENTIAL);
+
+    // every line takes at least 8 characters
+    line_segments.reserve(size / 8);
 
-        if (x1 == x2)
-        { // vertical line
+    const char *pos = text, *end = text + size;
+    while (pos < end)
+    { // read points inputed as p1.x p1.y p2.x p2.y
 
-            if (y2 < y1)
-            { // second point is less than first point
+        int values[4], n = 0;
+        while (pos < end && *pos != '\n')
+        { // parse the integers on this line
 
-                std::swap(x1, x2);
-                std::swap(y1, y2);
+            if (*pos == ' ' || *pos == '\t' || *pos == '\r')
+            {
+                pos++;
+                continue;
             }
 
-            // save points to vector of lines
-            line_segments.push_back(Line(Point({x1, y1}), Point({x2, y2})));
-        }
-
-        else if (y1 == y2)
-        { // horizontal line
+            bool negative = *pos == '-';
+            pos += negative || *pos == '+';
+            if (n == 4 || pos == end || *pos < '0' || *pos > '9')
+            {
+                n = -1;
+                break;
+            }
 
-            if (x2 < x1)
-            { // second point is less than first point
+            // stop growing the value once it is out of range
+            long long value = 0;
+            for (; pos < end && *pos >= '0' && *pos <= '9'; pos++)
+                if (value <= 1LL << 32)
+                    value = value * 10 + (*pos - '0');
+            value = negative ? -value : value;
 
-                std::swap(x1, x2);
-                std::swap(y1, y2);
+            if (value < INT32_MIN || value > INT32_MAX)
+            {
+                n = -1;
+                break;
             }
-
-            // save points to vector of lines
-            line_segments.push_back(Line(Point({x1, y1}), Point({x2, y2})));
+            values[n++] = value;
         }
 
-        else
-        { // there is a line that is not horizontal nor vertical
+        if (n == 4)
+            line_segments.push_back(normalise(values[0], values[1], values[2], values[3]));
+
+        else if (n != 0)
+        { // there is a line that is not four integers
             cout << "Invalide line in " << filename << " exiting" << endl;
             exit(1);
         }
+
+        // move past the new line
+        pos++;
     }
 
-    for (int i = 0; i < line_segments.size(); i++)
-    { // push vector of lines to a vector of events
+    munmap((void *)text, size);
+    return line_segments;
+}
 
-        line_events.push_back(Event(line_segments[i].p1.x, line_segments[i].p1.y,
-                                    line_segments[i], true));
-        line_events.push_back(Event(line_segments[i].p2.x, line_segments[i].p2.y,
-                                    line_segments[i], false));
-    }
+Line normalise(int x1, int y1, int x2, int y2)
+{ /*
+     This function normalises a line so that p1 is the
+     left most point, or the bottom most point of a
+     vertical line.
+                                                         */
+    if (x2 < x1 || (x1 == x2 && y2 < y1))
+    { // second point is less than first point
 
-    // sort all events based on x, y and type
-    std::sort(line_events.begin(), line_events.end(), event_sort);
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+    }
 
-    return line_events;
+    return Line(Point({x1, y1}), Point({x2, y2}));
 }
 
-bool event_sort(const Event &lhs, const Event &rhs)
+void writefile(const char *filename, const LineArray &line_segments)
 { /*
-     This function first sorts by x coordinate. If the x coordinates
-     are equal it will sort by the y coordinate. If the y coordinate
-     is equal it will sort by the boolean is_left attribute.
-                                                                         */
-    if (lhs.x == rhs.x)
-        return (lhs.y == rhs.y) ? lhs.is_left : lhs.y < rhs.y;
-    return lhs.x < rhs.x;
+     This function writes the lines to a binary line file,
+     a header followed by the normalised lines exactly as
+     they are laid out in memory.
+                                                         */
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
+
+    LineFileHeader header = {{'L', 'S', 'E', 'G'}, 1, line_segments.size()};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(line_segments.begin(), sizeof(Line), line_segments.size(), file);
+
+    if (fclose(file))
+    {
+        cout << "ERROR! Could not write " << filename << endl;
+        exit(1);
+    }
 }
 
-int sweep_line(std::vector<Event> line_events)
+std::vector<Window> readwindows(const char *filename)
 { /*
-     This function performs the sweep line algorithm. It
-     loops through all lines checking if they're active.
-     If they are active it counts the amount of intersections.
-     Otherwise it removes the line from the active_lines vector.
-                                                                     */
+     This function loads a query file in the same format
+     as the lines. Each line gives two opposite corners of
+     a window, so a horizontal or vertical probe line is
+     read as a window of zero height or width.
+                                                         */
+    std::vector<Window> windows;
+    for (auto &line : loadfile(filename))
+        windows.push_back(Window({line.p1.x, std::min(line.p1.y, line.p2.y),
+                                  line.p2.x, std::max(line.p1.y, line.p2.y)}));
+    return windows;
+}
 
-    // all lines that haven't returned a false is_left (active lines)
-    std::vector<Line> active_lines;
-    int count = 0;
+std::vector<long long> count_queries(const SegmentIndex &index,
+                                     const std::vector<Window> &windows, int threads)
+{ // count each window, splitting the batch between threads
+    threads = std::max(threads, 1);
+    std::vector<long long> counts(windows.size());
+    int n = windows.size();
+    parallel_for(threads, threads, [&](int t)
+    {
+        for (int i = (long long)n * t / threads; i < (long long)n * (t + 1) / threads; i++)
+            counts[i] = index.count(windows[i]);
+    });
+    return counts;
+}
 
-    for (auto event : line_events)
-    { // iterate through active lines
+void run_updates(const char *filename, DynamicLineSet &line_set)
+{ /*
+     This function applies an update file to the set. Lines
+     of the form "+ x1 y1 x2 y2" insert a line and "- x1 y1
+     x2 y2" erase one. A line holding only "=" prints the
+     current count, as does the end of the file.
+                                                         */
+    std::ifstream file(filename);
+    if (!file)
+    {
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
 
-        if (event.is_left)
-        { // its active so count intersects
+    std::string line;
+    while (std::getline(file, line))
+    { // read updates inputed as op x1 y1 x2 y2
 
-            for (auto line : active_lines)
-                count += intersections(line, event.line);
+        std::stringstream linestream(line);
+        std::string op;
+        int x1, y1, x2, y2;
+        if (!(linestream >> op))
+            continue;
 
-            // add line to active_lines list
-            active_lines.push_back(event.line);
+        if (op == "=")
+        {
+            cout << "Contains " << line_set.count() << " intersections" << endl;
+            continue;
         }
 
-        else
-            // not an active line so delete it
+        if ((op != "+" && op != "-") || !(linestream >> x1 >> y1 >> x2 >> y2) ||
+            (x1 != x2 && y1 != y2))
+        { // ensure the update is valid
+            cout << "Invalide update \"" << line << "\" in " << filename << " exiting" << endl;
+            exit(1);
+        }
 
-            for (auto it = active_lines.begin(); it < active_lines.end(); it++)
-                // search for the iterator
+        if (op == "+")
+            line_set.insert(normalise(x1, y1, x2, y2));
 
-                if (it->p1.x == event.line.p1.x && it->p1.y == event.line.p1.y &&
-                    it->p2.x == event.line.p2.x && it->p2.y == event.line.p2.y)
-                { // delete the line
+        else if (!line_set.erase(normalise(x1, y1, x2, y2)))
+            cout << "Line " << x1 << " " << y1 << " " << x2 << " " << y2
+                 << " is not present" << endl;
+    }
 
-                    active_lines.erase(it);
-                    break;
-                }
+    cout << "Contains " << line_set.count() << " intersections" << endl;
+}
+
+long long DynamicLineSet::crossings(const Window &window) const
+{
+    return starts[0].count(window.x1, window.x2, window.y2) -
+           (window.y1 == INT32_MIN ? 0 : ends[0].count(window.x1, window.x2, window.y1 - 1)) +
+           starts[1].count(window.y1, window.y2, window.x2) -
+           (window.x1 == INT32_MIN ? 0 : ends[1].count(window.y1, window.y2, window.x1 - 1));
+}
+
+void DynamicLineSet::insert(const Line &line)
+{
+    // count the lines already crossing it, including copies of it
+    total += crossings(Window({line.p1.x, line.p1.y, line.p2.x, line.p2.y}));
+    present[std::make_tuple(line.p1.x, line.p1.y, line.p2.x, line.p2.y)]++;
+
+    if (is_vertical(line))
+    {
+        starts[0].insert(line.p1.x, line.p1.y);
+        ends[0].insert(line.p1.x, line.p2.y);
+    }
+
+    else
+    {
+        starts[1].insert(line.p1.y, line.p1.x);
+        ends[1].insert(line.p1.y, line.p2.x);
     }
-    return count;
 }
 
-int intersections(const Line &l1, const Line &l2)
-{ /*
-     This function perfroms the counter clockwise algorithm 
-     on two lines. If the ccw of these 2 lines is > 0 there 
-     can't be an intersection. Add 1 to count if the ccw is not > 0
-                                                                     */
-    return ((ccw(l1.p1, l1.p2, l2.p1) *
-             ccw(l1.p1, l1.p2, l2.p2) > 0) ||
-            (ccw(l2.p1, l2.p2, l1.p1) *
-             ccw(l2.p1, l2.p2, l1.p2) > 0) ? 0 : 1);
-}
\ No newline at end of file
+bool DynamicLineSet::erase(const Line &line)
+{
+    auto it = present.find(std::make_tuple(line.p1.x, line.p1.y, line.p2.x, line.p2.y));
+    if (it == present.end())
+        return false;
+
+    if (--it->second == 0)
+        present.erase(it);
+
+    if (is_vertical(line))
+    {
+        starts[0].erase(line.p1.x, line.p1.y);
+        ends[0].erase(line.p1.x, line.p2.y);
+    }
+
+    else
+    {
+        starts[1].erase(line.p1.y, line.p1.x);
+        ends[1].erase(line.p1.y, line.p2.x);
+    }
+
+    // the line no longer crosses itself so this is what it added
+    total -= crossings(Window({line.p1.x, line.p1.y, line.p2.x, line.p2.y}));
+    return true;
+}
+
+void DominanceCounter::insert(int key, int value)
+{
+    for (unsigned long long i = bias(key) + 1ULL; i <= 1ULL << 32; i += i & -i)
+    {
+        int &root = roots[i];
+        root = pool.insert(root, value);
+    }
+}
+
+void DominanceCounter::erase(int key, int value)
+{
+    for (unsigned long long i = bias(key) + 1ULL; i <= 1ULL << 32; i += i & -i)
+    {
+        auto it = roots.find(i);
+        it->second = pool.erase(it->second, value);
+        if (it->second == 0)
+            roots.erase(it);
+    }
+}
+
+long long DominanceCounter::count(int key, int value) const
+{
+    long long sum = 0;
+    for (unsigned long long i = bias(key) + 1ULL; i > 0; i -= i & -i)
+    {
+        auto it = roots.find(i);
+        if (it != roots.end())
+            sum += pool.count(it->second, value);
+    }
+    return sum;
+}
+
+long long DominanceCounter::count(int key1, int key2, int value) const
+{
+    if (key1 > key2)
+        return 0;
+    return count(key2, value) - (key1 == INT32_MIN ? 0 : count(key1 - 1, value));
+}
+
+void TreapPool::split(int t, int key, bool equal_left, int &left, int &right)
+{ // split into keys before key (and equal to it if equal_left) and the rest
+    if (t == 0)
+    {
+        left = right = 0;
+        return;
+    }
+
+    if (nodes[t].key < key || (equal_left && nodes[t].key == key))
+    {
+        split(nodes[t].right, key, equal_left, nodes[t].right, right);
+        left = t;
+    }
+
+    else
+    {
+        split(nodes[t].left, key, equal_left, left, nodes[t].left);
+        right = t;
+    }
+    update(t);
+}
+
+int TreapPool::merge(int left, int right)
+{ // merge two treaps where every key in left is <= every key in right
+    if (left == 0 || right == 0)
+        return left ? left : right;
+
+    if (nodes[left].priority > nodes[right].priority)
+    {
+        nodes[left].right = merge(nodes[left].right, right);
+        update(left);
+        return left;
+    }
+
+    nodes[right].left = merge(left, nodes[right].left);
+    update(right);
+    return right;
+}
+
+int TreapPool::insert(int root, int key)
+{
+    // xorshift priorities keep the treap balanced in expectation
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    int t;
+    if (unused.empty())
+    {
+        t = nodes.size();
+        nodes.push_back(Node({key, seed, 1, 0, 0}));
+    }
+
+    else
+    {
+        t = unused.back();
+        unused.pop_back();
+        nodes[t] = Node({key, seed, 1, 0, 0});
+    }
+
+    int left, right;
+    split(root, key, false, left, right);
+    return merge(merge(left, t), right);
+}
+
+int TreapPool::erase(int root, int key)
+{
+    // isolate the keys equal to key and drop the root of them
+    int left, middle, right;
+    split(root, key, false, left, right);
+    split(right, key, true, middle, right);
+
+    if (middle != 0)
+    {
+        unused.push_back(middle);
+        middle = merge(nodes[middle].left, nodes[middle].right);
+    }
+    return merge(merge(left, middle), right);
+}
+
+int TreapPool::count(int root, int key) const
+{
+    int sum = 0;
+    for (int t = root; t != 0; )
+        if (nodes[t].key <= key)
+        {
+            sum += 1 + nodes[nodes[t].left].size;
+            t = nodes[t].right;
+        }
+
+        else
+            t = nodes[t].left;
+    return sum;
+}
+
+RangeTree::RangeTree(const LineArray &line_segments, bool vertical)
+{ /*
+     This function builds the tree from the lines of one
+     orientation, sorted by their shared value. Single
+     points count as vertical.
+                                                         */
+    std::vector<Span> spans;
+    for (int i = 0; i < (int)line_segments.size(); i++)
+    {
+        const Line &line = line_segments[i];
+        if (is_vertical(line) != vertical)
+            continue;
+
+        if (vertical)
+            spans.push_back(Span({true, line.p1.x, line.p1.y, line.p2.y, i}));
+
+        else
+            spans.push_back(Span({false, line.p1.y, line.p1.x, line.p2.x, i}));
+    }
+
+    std::sort(spans.begin(), spans.end());
+    for (auto &span : spans)
+        keys.push_back(span.at);
+
+    if (!spans.empty())
+        build(0, 0, spans.size(), spans);
+}
+
+void RangeTree::build(int depth, int l, int r, const std::vector<Span> &spans)
+{ /*
+     This function builds the node covering [l, r) of the
+     sorted lines at the given depth by merging its two
+     children by start.
+                                                         */
+    if (depth == (int)starts.size())
+    { // first node at this depth
+        int n = spans.size();
+        starts.push_back(std::vector<int>(n));
+        stops.push_back(std::vector<int>(n));
+        lines.push_back(std::vector<int>(n));
+        ends.push_back(std::vector<int>(n));
+        max_ends.push_back(std::vector<int>(2 * n));
+    }
+
+    if (r - l == 1)
+    { // a single line
+        starts[depth][l] = spans[l].start;
+        stops[depth][l] = ends[depth][l] = spans[l].end;
+        lines[depth][l] = spans[l].line;
+    }
+
+    else
+    {
+        int mid = (l + r) / 2;
+        build(depth + 1, l, mid, spans);
+        build(depth + 1, mid, r, spans);
+
+        // merge the children by start
+        for (int i = l, j = mid, k = l; k < r; k++)
+        {
+            int from = (j == r || (i < mid && starts[depth + 1][i] <= starts[depth + 1][j]))
+                       ? i++ : j++;
+            starts[depth][k] = starts[depth + 1][from];
+            stops[depth][k] = stops[depth + 1][from];
+            lines[depth][k] = lines[depth + 1][from];
+        }
+
+        std::merge(ends[depth + 1].begin() + l, ends[depth + 1].begin() + mid,
+                   ends[depth + 1].begin() + mid, ends[depth + 1].begin() + r,
+                   ends[depth].begin() + l);
+    }
+
+    build_max(depth, l, 0, r - l - 1);
+}
+
+int RangeTree::build_max(int depth, int l, int lo, int hi)
+{ // fill the max tree of the node starting at l over entries [lo, hi]
+    int &max = max_ends[depth][2 * l + max_node(lo, hi)];
+    if (lo == hi)
+        return max = stops[depth][l + lo];
+
+    int mid = (lo + hi) / 2;
+    return max = std::max(build_max(depth, l, lo, mid), build_max(depth, l, mid + 1, hi));
+}
+
+long long RangeTree::count(int key1, int key2, int a, int b) const
+{
+    int pl = std::lower_bound(keys.begin(), keys.end(), key1) - keys.begin();
+    int pr = std::upper_bound(keys.begin(), keys.end(), key2) - keys.begin();
+    return pl < pr ? count(0, 0, keys.size(), pl, pr, a, b) : 0;
+}
+
+long long RangeTree::count(int depth, int l, int r, int pl, int pr, int a, int b) const
+{ /*
+     This function counts the lines in [pl, pr) of the node
+     covering [l, r) whose extent overlaps [a, b]. Every line
+     ending before a also starts before b, so the count is
+     the lines starting at or before b minus those ending
+     before a.
+                                                         */
+    if (pr <= l || r <= pl)
+        return 0;
+
+    if (pl <= l && r <= pr)
+    { // the whole node is in range
+        auto first = starts[depth].begin() + l, last = starts[depth].begin() + r;
+        auto first_end = ends[depth].begin() + l, last_end = ends[depth].begin() + r;
+        return (std::upper_bound(first, last, b) - first) -
+               (std::lower_bound(first_end, last_end, a) - first_end);
+    }
+
+    int mid = (l + r) / 2;
+    return count(depth + 1, l, mid, pl, pr, a, b) + count(depth + 1, mid, r, pl, pr, a, b);
+}
+
+template<typename Report>
+long long RangeTree::report(int key1, int key2, int a, int b, Report &report) const
+{
+    int pl = std::lower_bound(keys.begin(), keys.end(), key1) - keys.begin();
+    int pr = std::upper_bound(keys.begin(), keys.end(), key2) - keys.begin();
+    return pl < pr ? this->report(0, 0, keys.size(), pl, pr, a, b, report) : 0;
+}
+
+template<typename Report>
+long long RangeTree::report(int depth, int l, int r, int pl, int pr, int a, int b,
+                            Report &report) const
+{ /*
+     This function reports the lines counted by count. In a
+     node that is wholly in range the lines starting at or
+     before b are a prefix in start order, and the max tree
+     leads only to the ones among them ending at or after a.
+                                                         */
+    if (pr <= l || r <= pl)
+        return 0;
+
+    if (pl <= l && r <= pr)
+    { // the whole node is in range
+        auto first = starts[depth].begin() + l, last = starts[depth].begin() + r;
+        int p = std::upper_bound(first, last, b) - first;
+        return report_node(depth, l, 0, r - l - 1, p, a, report);
+    }
+
+    int mid = (l + r) / 2;
+    return this->report(depth + 1, l, mid, pl, pr, a, b, report) +
+           this->report(depth + 1, mid, r, pl, pr, a, b, report);
+}
+
+template<typename Report>
+long long RangeTree::report_node(int depth, int l, int lo, int hi, int p, int a,
+                                 Report &report) const
+{ // report entries [lo, hi] of the node before p whose end is at least a
+    if (lo >= p || max_ends[depth][2 * l + max_node(lo, hi)] < a)
+        return 0;
+
+    if (lo == hi)
+    {
+        report(lines[depth][l + lo]);
+        return 1;
+    }
+
+    int mid = (lo + hi) / 2;
+    return report_node(depth, l, lo, mid, p, a, report) +
+           report_node(depth, l, mid + 1, hi, p, a, report);
+}
+
+LineArray::LineArray(LineArray &&other)
+    : owned(std::move(other.owned)), lines(other.lines), count(other.count),
+      mapping(other.mapping), mapped(other.mapped)
+{
+    other.mapping = nullptr;
+}
+
+EventList build_events(const LineArray &line_segments)
+{ /*
+     This function loads the lines into a list of events
+     and initialises their keys. Events are sorted by x
+     coordinate, then by y coordinate and then with left
+     ends first. The y coordinates are replaced by their
+     rank so the whole order fits in one key.
+                                                         */
+
+    // rank all y values
+    std::vector<int> ys;
+    for (auto &line : line_segments)
+    {
+        ys.push_back(line.p1.y);
+        ys.push_back(line.p2.y);
+    }
+
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    auto rank = [&](int y)
+    { return (unsigned int)(std::lower_bound(ys.begin(), ys.end(), y) - ys.begin()); };
+
+    // all line events (innactive/active)
+    EventList line_events;
+
+    for (int i = 0; i < (int)line_segments.size(); i++)
+    { // push vector of lines to a list of events
+
+        line_events.push(line_segments[i].p1.x, rank(line_segments[i].p1.y) << 1, i);
+        line_events.push(line_segments[i].p2.x, rank(line_segments[i].p2.y) << 1 | 1, i);
+    }
+
+    // sort all events based on x, y and type
+    radix_sort(line_events);
+
+    return line_events;
+}
+
+long long sweep_line(const EventList &line_events, const LineArray &line_segments)
+{ /*
+     This function performs the sweep line algorithm. It
+     loops through all lines checking if they're active.
+     If they are active it counts the amount of intersections.
+     Otherwise it removes the line from the active_lines vector.
+     It is O(n^2) and is kept as a reference for sweep_count.
+                                                                     */
+
+    // all lines that haven't returned a false is_left (active lines)
+    std::vector<int> active_lines;
+    long long count = 0;
+
+    for (int e = 0; e < line_events.size(); e++)
+    { // iterate through active lines
+
+        int event = line_events.line[e];
+
+        if (!(line_events.order(e) & 1))
+        { // its active so count intersects
+
+            for (auto line : active_lines)
+                count += intersections(line_segments[line], line_segments[event]);
+
+            // add line to active_lines list
+            active_lines.push_back(event);
+        }
+
+        else
+            // not an active line so delete it
+
+            for (auto it = active_lines.begin(); it < active_lines.end(); it++)
+                // search for the iterator
+
+                if (*it == event)
+                { // delete the line
+
+                    active_lines.erase(it);
+                    break;
+                }
+    }
+    return count;
+}
+
+long long sweep_count(const LineArray &line_segments)
+{ /*
+     This function counts intersections in O(n log n). The
+     active horizontal lines are held in a Fenwick tree keyed
+     by their compressed y value, so each vertical line is a
+     single range count of the horizontals it spans. Lines
+     that overlap along the same x or y are counted separately
+     by collinear_overlaps.
+                                                                     */
+
+    // compress the y values of all horizontal lines
+    std::vector<int> ys;
+    for (auto &line : line_segments)
+        if (!is_vertical(line))
+            ys.push_back(line.p1.y);
+
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    Fenwick active(ys.size());
+    long long count = collinear_overlaps(line_segments);
+
+    EventList sweep_events = build_sweep_events(line_segments);
+
+    for (int e = 0; e < sweep_events.size(); e++)
+    { // iterate through the events from left to right
+
+        const Line &line = line_segments[sweep_events.line[e]];
+
+        if (sweep_events.order(e) == 1)
+        { // count the active horizontals within the vertical line
+
+            int lo = std::lower_bound(ys.begin(), ys.end(), line.p1.y) - ys.begin();
+            int hi = std::upper_bound(ys.begin(), ys.end(), line.p2.y) - ys.begin();
+            count += active.range(lo, hi);
+        }
+
+        else
+        { // activate or deactivate the horizontal line
+
+            int y = std::lower_bound(ys.begin(), ys.end(), line.p1.y) - ys.begin();
+            active.add(y, sweep_events.order(e) == 0 ? 1 : -1);
+        }
+    }
+    return count;
+}
+
+long long sweep_parallel(const LineArray &line_segments, int threads)
+{ /*
+     This function performs sweep_count across threads. The
+     events are cut into one slab per thread with roughly equal
+     event counts, never splitting the events of a single x.
+     Each slab first lists the net change it makes to the
+     active count of each y, sparse and sorted, in parallel.
+     Each slab then builds its own Fenwick tree from the lists
+     of the slabs before it, so it starts with the horizontals
+     that cross its left edge without a serial pass or a copy
+     of the counts per slab. Every vertical line is counted by
+     exactly one slab and the slab counts are simply added
+     together.
+                                                                     */
+
+    // compress the y values of all horizontal lines
+    std::vector<int> ys;
+    for (auto &line : line_segments)
+        if (!is_vertical(line))
+            ys.push_back(line.p1.y);
+
+    parallel_sort(ys, std::less<int>(), threads);
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    // compressed y of each line, only used for horizontals
+    int n = line_segments.size();
+    std::vector<int> rank(n);
+    parallel_for(threads, threads, [&](int t)
+    {
+        for (int i = (long long)n * t / threads; i < (long long)n * (t + 1) / threads; i++)
+            rank[i] = std::lower_bound(ys.begin(), ys.end(),
+                                       line_segments[i].p1.y) - ys.begin();
+    });
+
+    EventList sweep_events = build_sweep_events(line_segments, threads);
+
+    // cut the events into slabs at x changes
+    std::vector<int> bounds(1, 0);
+    for (int t = 1; t < threads; t++)
+    {
+        int b = std::max((long long)bounds.back(),
+                         (long long)sweep_events.size() * t / threads);
+        while (b > 0 && b < sweep_events.size() &&
+               sweep_events.x(b) == sweep_events.x(b - 1))
+            b++;
+        bounds.push_back(b);
+    }
+    bounds.push_back(sweep_events.size());
+
+    // the net change each slab makes to the active count of each y rank
+    std::vector<std::vector<std::pair<int, int>>> changes(threads);
+    parallel_for(threads - 1, threads, [&](int slab)
+    {
+        auto &change = changes[slab];
+        for (int e = bounds[slab]; e < bounds[slab + 1]; e++)
+            if (sweep_events.order(e) != 1)
+                change.emplace_back(rank[sweep_events.line[e]],
+                                    sweep_events.order(e) == 0 ? 1 : -1);
+        std::sort(change.begin(), change.end());
+
+        // merge the changes to each rank, dropping those that cancel
+        int kept = 0;
+        for (int i = 0, j; i < (int)change.size(); i = j)
+        {
+            int sum = 0;
+            for (j = i; j < (int)change.size() && change[j].first == change[i].first; j++)
+                sum += change[j].second;
+            if (sum)
+                change[kept++] = std::make_pair(change[i].first, sum);
+        }
+        change.resize(kept);
+    });
+
+    std::vector<long long> counts(threads, 0);
+
+    parallel_for(threads, threads, [&](int slab)
+    {
+        if (bounds[slab] == bounds[slab + 1])
+            return;
+
+        // start with the horizontals the earlier slabs left active
+        Fenwick active(ys.size());
+        for (int k = 0; k < slab; k++)
+            active.seed(changes[k]);
+        active.build();
+
+        for (int e = bounds[slab]; e < bounds[slab + 1]; e++)
+        { // iterate through the events of the slab
+
+            int event = sweep_events.line[e];
+            const Line &line = line_segments[event];
+
+            if (sweep_events.order(e) == 1)
+            { // count the active horizontals within the vertical line
+
+                int lo = std::lower_bound(ys.begin(), ys.end(), line.p1.y) - ys.begin();
+                int hi = std::upper_bound(ys.begin(), ys.end(), line.p2.y) - ys.begin();
+                counts[slab] += active.range(lo, hi);
+            }
+
+            else
+                // activate or deactivate the horizontal line
+
+                active.add(rank[event], sweep_events.order(e) == 0 ? 1 : -1);
+        }
+    });
+
+    long long count = collinear_overlaps(line_segments, threads);
+    for (auto c : counts)
+        count += c;
+    return count;
+}
+
+template<typename Report>
+long long sweep_report(const LineArray &line_segments, Report &report)
+{ /*
+     This function reports every intersection in O(n log n + k).
+     The active horizontal lines are held in a set ordered by y,
+     so each vertical line walks only the horizontals it crosses.
+     Each intersection is passed to report as it is found and
+     nothing is kept, so k is only limited by the output.
+                                                                     */
+
+    // active horizontal lines as (y, index)
+    std::set<std::pair<int, int>> active;
+    long long count = collinear_report(line_segments, report);
+
+    EventList sweep_events = build_sweep_events(line_segments);
+
+    for (int e = 0; e < sweep_events.size(); e++)
+    { // iterate through the events from left to right
+
+        int event = sweep_events.line[e];
+        const Line &line = line_segments[event];
+
+        if (sweep_events.order(e) == 0)
+            active.emplace(line.p1.y, event);
+
+        else if (sweep_events.order(e) == 2)
+            active.erase(std::make_pair(line.p1.y, event));
+
+        else
+            // report the active horizontals within the vertical line
+
+            for (auto it = active.lower_bound(std::make_pair(line.p1.y, -1));
+                 it != active.end() && it->first <= line.p2.y; it++, count++)
+
+                report(Intersection({std::min(it->second, event),
+                                     std::max(it->second, event),
+                                     RationalPoint(line.p1.x, it->first)}));
+    }
+    return count;
+}
+
+EventList build_sweep_events(const LineArray &line_segments, int threads)
+{ /*
+     This function turns each horizontal line into a start
+     and an end event and each vertical line into a single
+     event. Events are sorted by x and at each x horizontals
+     start before verticals and end after them, so touching
+     end points are counted as intersections.
+                                                                     */
+    EventList sweep_events;
+    for (int i = 0; i < (int)line_segments.size(); i++)
+
+        if (is_vertical(line_segments[i]))
+            sweep_events.push(line_segments[i].p1.x, 1, i);
+
+        else
+        {
+            sweep_events.push(line_segments[i].p1.x, 0, i);
+            sweep_events.push(line_segments[i].p2.x, 2, i);
+        }
+
+    // sort all events based on x and type
+    radix_sort(sweep_events, threads);
+
+    return sweep_events;
+}
+
+void radix_sort(EventList &events, int threads)
+{ /*
+     This function performs a stable LSD radix sort of the
+     event keys, moving the line indices along with them.
+     Each pass counts one byte of the keys per thread chunk,
+     turns the counts into per thread offsets and scatters.
+     Passes where every key shares the byte are skipped, so
+     the unused low bytes of the counting sweep keys cost
+     nothing.
+                                                                     */
+    int n = events.size();
+    EventList sorted;
+    sorted.key.resize(n);
+    sorted.line.resize(n);
+
+    std::vector<int> bounds;
+    for (int t = 0; t <= threads; t++)
+        bounds.push_back((long long)n * t / threads);
+
+    std::vector<std::vector<int>> offsets(threads, std::vector<int>(256));
+
+    for (int shift = 0; shift < 64; shift += 8)
+    { // sort by each byte from least to most significant
+
+        parallel_for(threads, threads, [&](int t)
+        {
+            std::fill(offsets[t].begin(), offsets[t].end(), 0);
+            for (int i = bounds[t]; i < bounds[t + 1]; i++)
+                offsets[t][events.key[i] >> shift & 255]++;
+        });
+
+        // skip the pass if every key has the same byte
+        int used = 0;
+        for (int digit = 0; digit < 256; digit++)
+        {
+            int total = 0;
+            for (int t = 0; t < threads; t++)
+                total += offsets[t][digit];
+            used += total > 0;
+        }
+        if (used <= 1)
+            continue;
+
+        // turn the counts into the position of each thread's first key
+        int position = 0;
+        for (int digit = 0; digit < 256; digit++)
+            for (int t = 0; t < threads; t++)
+            {
+                int count = offsets[t][digit];
+                offsets[t][digit] = position;
+                position += count;
+            }
+
+        parallel_for(threads, threads, [&](int t)
+        {
+            for (int i = bounds[t]; i < bounds[t + 1]; i++)
+            {
+                int position = offsets[t][events.key[i] >> shift & 255]++;
+                sorted.key[position] = events.key[i];
+                sorted.line[position] = events.line[i];
+            }
+        });
+
+        std::swap(events.key, sorted.key);
+        std::swap(events.line, sorted.line);
+    }
+}
+
+std::vector<Span> build_spans(const LineArray &line_segments, int threads)
+{ /*
+     This function returns every line as a span along its
+     shared x or y value, sorted by (orientation, shared
+     value, start) so overlapping lines are grouped.
+                                                                     */
+    std::vector<Span> spans;
+    for (int i = 0; i < (int)line_segments.size(); i++)
+    {
+        const Line &line = line_segments[i];
+
+        if (is_vertical(line))
+            spans.push_back(Span({true, line.p1.x, line.p1.y, line.p2.y, i}));
+
+        else
+            spans.push_back(Span({false, line.p1.y, line.p1.x, line.p2.x, i}));
+    }
+
+    parallel_sort(spans, std::less<Span>(), threads);
+
+    return spans;
+}
+
+long long collinear_overlaps(const LineArray &line_segments, int threads)
+{ /*
+     This function counts the pairs of horizontal lines that
+     share a y value and overlap, and the pairs of vertical
+     lines that share an x value and overlap. The sorted spans
+     are split between threads at group boundaries.
+                                                                     */
+    std::vector<Span> spans = build_spans(line_segments, threads);
+
+    // cut the spans into chunks at the start of a group
+    std::vector<int> bounds(1, 0);
+    for (int t = 1; t < threads; t++)
+    {
+        int b = std::max((long long)bounds.back(), (long long)spans.size() * t / threads);
+        while (b > 0 && b < (int)spans.size() && spans[b].vertical == spans[b - 1].vertical &&
+               spans[b].at == spans[b - 1].at)
+            b++;
+        bounds.push_back(b);
+    }
+    bounds.push_back(spans.size());
+
+    std::vector<long long> counts(threads, 0);
+    parallel_for(threads, threads, [&](int t)
+    { counts[t] = collinear_range(spans, bounds[t], bounds[t + 1]); });
+
+    long long count = 0;
+    for (auto c : counts)
+        count += c;
+    return count;
+}
+
+long long collinear_range(const std::vector<Span> &spans, int begin, int end)
+{ /*
+     This function counts the overlapping pairs in the spans
+     [begin, end), which must hold whole groups. Each group is
+     swept keeping a min heap of the ends of earlier lines.
+                                                                     */
+    std::priority_queue<int, std::vector<int>, std::greater<int>> ends;
+    long long count = 0;
+
+    for (int i = begin; i < end; i++)
+    { // iterate through the groups of lines
+
+        if (i > begin && (spans[i].vertical != spans[i - 1].vertical ||
+                          spans[i].at != spans[i - 1].at))
+            // start of a new group
+
+            ends = decltype(ends)();
+
+        // drop the lines that ended before this one starts
+        while (!ends.empty() && ends.top() < spans[i].start)
+            ends.pop();
+
+        // every line left in the heap overlaps this one
+        count += ends.size();
+        ends.push(spans[i].end);
+    }
+    return count;
+}
+
+template<typename Report>
+long long collinear_report(const LineArray &line_segments, Report &report)
+{ /*
+     This function reports the overlapping pairs counted by
+     collinear_overlaps. Earlier lines in a group are kept
+     in a set ordered by end so the ones that finished can
+     be dropped from the front. The reported point is where
+     the overlap begins.
+                                                                     */
+    std::vector<Span> spans = build_spans(line_segments);
+
+    // earlier lines in the group as (end, index)
+    std::set<std::pair<int, int>> ends;
+    long long count = 0;
+
+    for (int i = 0; i < (int)spans.size(); i++)
+    { // iterate through the groups of lines
+
+        if (i > 0 && (spans[i].vertical != spans[i - 1].vertical ||
+                      spans[i].at != spans[i - 1].at))
+            // start of a new group
+
+            ends.clear();
+
+        // drop the lines that ended before this one starts
+        while (!ends.empty() && ends.begin()->first < spans[i].start)
+            ends.erase(ends.begin());
+
+        // every line left in the set overlaps this one
+        RationalPoint point = spans[i].vertical ? RationalPoint(spans[i].at, spans[i].start)
+                                                : RationalPoint(spans[i].start, spans[i].at);
+        for (auto &other : ends)
+        {
+            report(Intersection({std::min(other.second, spans[i].line),
+                                 std::max(other.second, spans[i].line), point}));
+            count++;
+        }
+
+        ends.emplace(spans[i].end, spans[i].line);
+    }
+    return count;
+}
+
+template<typename Report>
+long long bentley_ottmann(const LineArray &line_segments, Report *report)
+{ /*
+     This function counts the intersections of lines with any
+     slope using the Bentley-Ottmann sweep in O((n + i) log n),
+     where i is the number of distinct intersection points.
+     Event points are exact rationals and every predicate is
+     computed exactly in 128 bits, which holds for coordinates
+     within +-2^30. At each event point every line through it
+     is collected, so many lines meeting at one point and lines
+     sharing end points are handled together. Collinear lines
+     that overlap share many points, so they are only counted
+     at the first point of their overlap, which is always the
+     left end of one of them. If report is not null every
+     intersecting pair is passed to it.
+                                                                     */
+    const int limit = 1 << 30;
+    for (auto &line : line_segments)
+        for (auto value : {line.p1.x, line.p1.y, line.p2.x, line.p2.y})
+            if (value < -limit || value > limit)
+            { // ensure the exact predicates cannot overflow
+                cout << "ERROR! Coordinates must be within +-" << limit
+                     << " when lines are not horizontal nor vertical" << endl;
+                exit(1);
+            }
+
+    // event points with the lines that start at them
+    std::map<RationalPoint, std::vector<int>> queue;
+    for (int i = 0; i < (int)line_segments.size(); i++)
+    {
+        queue[RationalPoint(line_segments[i].p1.x, line_segments[i].p1.y)].push_back(i);
+        queue[RationalPoint(line_segments[i].p2.x, line_segments[i].p2.y)];
+    }
+
+    RationalPoint point(0, 0);
+    std::set<int, StatusOrder> status(StatusOrder({&line_segments, &point}));
+    long long count = 0;
+
+    // lines through the event point and the lines to put back in the status
+    std::vector<std::pair<int, bool>> through;
+    std::vector<int> reinsert;
+
+    while (!queue.empty())
+    { // handle the event points from left to right
+
+        point = queue.begin()->first;
+        through.clear();
+        for (auto line : queue.begin()->second)
+            through.push_back(std::make_pair(line, true));
+        queue.erase(queue.begin());
+
+        // the active lines through the point are next to each other
+        auto lo = status.lower_bound(-1), hi = status.upper_bound(-1);
+        for (auto it = lo; it != hi; it++)
+            through.push_back(std::make_pair(*it, false));
+        status.erase(lo, hi);
+
+        /*
+            Sort the lines through the point by direction, with the
+            lines starting here first among equal directions. Lines
+            with the same direction are collinear and form a group.
+            Pairs from different groups meet only at this point.
+            Pairs within a group are counted only if one of them
+            starts here. Single points have no direction and are
+            each a group of their own.
+                                                                    */
+        std::sort(through.begin(), through.end(),
+                  [&](const std::pair<int, bool> &lhs, const std::pair<int, bool> &rhs)
+                  {
+                      const Line &l1 = line_segments[lhs.first], &l2 = line_segments[rhs.first];
+                      if (direction_sort(l1, l2) || direction_sort(l2, l1))
+                          return direction_sort(l1, l2);
+                      return lhs.second != rhs.second ? lhs.second : lhs.first < rhs.first;
+                  });
+
+        auto same_group = [&](int a, int b)
+        {
+            const Line &l1 = line_segments[through[a].first], &l2 = line_segments[through[b].first];
+            return !direction_sort(l1, l2) && !direction_sort(l2, l1) &&
+                   (l1.p1.x != l1.p2.x || l1.p1.y != l1.p2.y);
+        };
+
+        long long m = through.size();
+        count += m * (m - 1) / 2;
+
+        for (int begin = 0, end = 0; begin < m; begin = end)
+        { // remove the collinear pairs that do not start here
+
+            long long starting = 0;
+            for (end = begin; end < m && same_group(begin, end); end++)
+                starting += through[end].second;
+
+            // a single point has no direction so end did not move
+            end = std::max(end, begin + 1);
+
+            long long size = end - begin;
+            count -= (size - starting) * (size - starting - 1) / 2;
+
+            if (report)
+                // report the pairs from later groups and the pairs starting here
+
+                for (int i = begin; i < end; i++)
+                    for (int j = (i - begin < starting ? i + 1 : end); j < m; j++)
+
+                        (*report)(Intersection({std::min(through[i].first, through[j].first),
+                                                std::max(through[i].first, through[j].first),
+                                                point}));
+        }
+
+        // put back the lines that continue past the point, ordered by slope
+        reinsert.clear();
+        for (auto &line : through)
+        {
+            const Point &end = line_segments[line.first].p2;
+            if (!(RationalPoint(end.x, end.y) == point))
+                reinsert.push_back(line.first);
+        }
+        status.insert(reinsert.begin(), reinsert.end());
+
+        // look for intersections between the new neighbours
+        auto first = status.lower_bound(-1), last = status.upper_bound(-1);
+        if (first == last)
+        { // nothing continues through the point so its neighbours meet
+
+            if (first != status.begin() && last != status.end())
+                find_event(line_segments, *std::prev(first), *last, point, queue);
+        }
+
+        else
+        { // check the lowest and highest lines through the point
+
+            if (first != status.begin())
+                find_event(line_segments, *std::prev(first), *first, point, queue);
+
+            if (last != status.end())
+                find_event(line_segments, *std::prev(last), *last, point, queue);
+        }
+    }
+    return count;
+}
+
+void find_event(const LineArray &line_segments, int l1, int l2,
+                const RationalPoint &point, std::map<RationalPoint, std::vector<int>> &queue)
+{ /*
+     This function adds the point where two neighbouring lines
+     cross to the event queue if it lies right of the current
+     event point. Parallel lines never cross at a single point,
+     and collinear lines that overlap are found at the left end
+     of the overlap, which is already an event.
+                                                                     */
+    const Point &p = line_segments[l1].p1, &q = line_segments[l2].p1;
+    int128 rx = line_segments[l1].p2.x - (long long)p.x, ry = line_segments[l1].p2.y - (long long)p.y;
+    int128 sx = line_segments[l2].p2.x - (long long)q.x, sy = line_segments[l2].p2.y - (long long)q.y;
+    int128 qx = q.x - (long long)p.x, qy = q.y - (long long)p.y;
+
+    // the lines meet at p + t * r = q + u * s
+    int128 denom = rx * sy - ry * sx;
+    int128 t = qx * sy - qy * sx;
+    int128 u = qx * ry - qy * rx;
+    if (denom == 0)
+        return;
+
+    if (denom < 0)
+    {
+        denom = -denom;
+        t = -t;
+        u = -u;
+    }
+
+    if (t < 0 || t > denom || u < 0 || u > denom)
+        return;
+
+    RationalPoint cross(p.x * denom + rx * t, p.y * denom + ry * t, denom);
+    if (point < cross)
+        queue[cross];
+}
+
+bool direction_sort(const Line &l1, const Line &l2)
+{ /*
+     This function sorts lines by the angle of p1 to p2, from
+     pointing down to pointing up. Every line points right or
+     straight up, so the cross product orders them. Single
+     points have no direction and sort first.
+                                                                     */
+    bool point1 = l1.p1.x == l1.p2.x && l1.p1.y == l1.p2.y;
+    bool point2 = l2.p1.x == l2.p2.x && l2.p1.y == l2.p2.y;
+    if (point1 || point2)
+        return point1 && !point2;
+
+    // ccw of the two directions from a shared origin
+    int128 dx1 = l1.p2.x - (long long)l1.p1.x, dy1 = l1.p2.y - (long long)l1.p1.y;
+    int128 dx2 = l2.p2.x - (long long)l2.p1.x, dy2 = l2.p2.y - (long long)l2.p1.y;
+    return dx1 * dy2 - dx2 * dy1 > 0;
+}
+
+int StatusOrder::side(int line) const
+{
+    const Line &l = (*line_segments)[line];
+
+    // ccw of p1, p2 and the event point scaled by its denominator
+    int128 dx = l.p2.x - (long long)l.p1.x, dy = l.p2.y - (long long)l.p1.y;
+    int128 orientation = dx * (point->y - l.p1.y * point->d) -
+                         (point->x - l.p1.x * point->d) * dy;
+
+    // the point is left of a line pointing right when the line is below it
+    return -sign(orientation);
+}
+
+bool StatusOrder::operator()(int lhs, int rhs) const
+{
+    if (lhs == -1)
+        return side(rhs) > 0;
+
+    if (rhs == -1)
+        return side(lhs) < 0;
+
+    int side1 = side(lhs), side2 = side(rhs);
+    if (side1 != side2)
+        return side1 < side2;
+
+    /*
+        The sweep only compares lines through the event point
+        against each other, ordering them by slope and then by
+        index so that collinear lines stay distinct.
+                                                                    */
+    const Line &l1 = (*line_segments)[lhs], &l2 = (*line_segments)[rhs];
+    if (direction_sort(l1, l2) || direction_sort(l2, l1))
+        return direction_sort(l1, l2);
+    return lhs < rhs;
+}
+
+bool RationalPoint::operator<(const RationalPoint &rhs) const
+{
+    int order = compare_fractions(x, d, rhs.x, rhs.d);
+    return order ? order < 0 : compare_fractions(y, d, rhs.y, rhs.d) < 0;
+}
+
+bool RationalPoint::operator==(const RationalPoint &rhs) const
+{
+    return !compare_fractions(x, d, rhs.x, rhs.d) && !compare_fractions(y, d, rhs.y, rhs.d);
+}
+
+int compare_fractions(int128 a, int128 b, int128 c, int128 d)
+{ /*
+     This function returns the sign of a / b - c / d for b, d > 0
+     without multiplying, so it cannot overflow. It compares the
+     whole parts and then the remainders as continued fractions,
+     flipping the order each time the fractions are inverted.
+                                                                     */
+    int flip = 1;
+    while (true)
+    {
+        int128 q1 = floor_div(a, b), q2 = floor_div(c, d);
+        if (q1 != q2)
+            return q1 < q2 ? -flip : flip;
+
+        // remainders are in [0, b) and [0, d)
+        a -= q1 * b;
+        c -= q2 * d;
+        if (a == 0 || c == 0)
+            return a == c ? 0 : (a == 0 ? -flip : flip);
+
+        // a / b < c / d exactly when b / a > d / c
+        std::swap(a, b);
+        std::swap(c, d);
+        flip = -flip;
+    }
+}
+
+int128 floor_div(int128 a, int128 b)
+{ // division rounding down for b > 0
+    int128 q = a / b;
+    return (a % b != 0 && a < 0) ? q - 1 : q;
+}
+
+int128 gcd(int128 a, int128 b)
+{ // greatest common divisor of |a| and |b|
+    a = a < 0 ? -a : a;
+    b = b < 0 ? -b : b;
+    while (b != 0)
+    {
+        int128 r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+IntersectionWriter::IntersectionWriter(const char *filename)
+    : file(strcmp(filename, "-") ? fopen(filename, "w") : stdout), buffer(1 << 20)
+{
+    if (!file)
+    { // ensure the output can be written
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
+}
+
+IntersectionWriter::~IntersectionWriter()
+{
+    flush();
+    if (file != stdout)
+        fclose(file);
+}
+
+void IntersectionWriter::put(int128 value, char end)
+{
+    // format the digits backwards into a small buffer
+    char digits[40];
+    int n = 0;
+    unsigned __int128 magnitude = value < 0 ? -(unsigned __int128)value : value;
+    do
+        digits[n++] = '0' + (int)(magnitude % 10);
+    while (magnitude /= 10);
+
+    if (value < 0)
+        buffer[used++] = '-';
+    while (n > 0)
+        buffer[used++] = digits[--n];
+    buffer[used++] = end;
+}
+
+void IntersectionWriter::put(int128 num, int128 den, char end)
+{
+    int128 divisor = gcd(num, den);
+    if (den == divisor)
+        put(num / divisor, end);
+
+    else
+    {
+        put(num / divisor, '/');
+        put(den / divisor, end);
+    }
+}
+
+void IntersectionWriter::operator()(const Intersection &hit)
+{
+    // each intersection needs at most 6 numbers of 41 characters
+    if (used + 6 * 41 > buffer.size())
+        flush();
+
+    put(hit.line1, ' ');
+    put(hit.line2, ' ');
+    put(hit.point.x, hit.point.d, ' ');
+    put(hit.point.y, hit.point.d, '\n');
+}
+
+void IntersectionWriter::operator()(long long first)
+{
+    if (used + 21 > buffer.size())
+        flush();
+
+    put(first, '\n');
+}
+
+void IntersectionWriter::operator()(long long first, long long second)
+{
+    if (used + 2 * 21 > buffer.size())
+        flush();
+
+    put(first, ' ');
+    put(second, '\n');
+}
+
+void IntersectionWriter::flush()
+{
+    fwrite(buffer.data(), 1, used, file);
+    used = 0;
+}
+
+template<typename Task>
+void parallel_for(int tasks, int threads, Task task)
+{ /*
+     This function runs task(0) to task(tasks - 1) on a pool
+     of threads. Each thread takes the next task index until
+     none are left.
+                                                                     */
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int i = next++; i < tasks; i = next++)
+            task(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < std::min(tasks, threads); t++)
+        pool.push_back(std::thread(worker));
+
+    worker();
+    for (auto &thread : pool)
+        thread.join();
+}
+
+template<typename T, typename Compare>
+void parallel_sort(std::vector<T> &items, Compare compare, int threads)
+{ /*
+     This function sorts one chunk of items per thread and
+     then merges neighbouring chunks in parallel rounds until
+     a single sorted run is left.
+                                                                     */
+    std::vector<size_t> bounds;
+    for (int t = 0; t <= threads; t++)
+        bounds.push_back(items.size() * t / threads);
+
+    parallel_for(threads, threads, [&](int t)
+    { std::sort(items.begin() + bounds[t], items.begin() + bounds[t + 1], compare); });
+
+    for (int width = 1; width < threads; width *= 2)
+    { // merge pairs of runs that are width chunks long
+
+        int merges = (threads + 2 * width - 1) / (2 * width);
+        parallel_for(merges, threads, [&](int m)
+        {
+            int lo = 2 * width * m;
+            int mid = std::min(lo + width, threads);
+            int hi = std::min(lo + 2 * width, threads);
+            std::inplace_merge(items.begin() + bounds[lo], items.begin() + bounds[mid],
+                               items.begin() + bounds[hi], compare);
+        });
+    }
+}
+
+int intersections(const Line &l1, const Line &l2)
+{ /*
+     This function perfroms the counter clockwise algorithm
+     on two lines. If both ends of one line are on the same
+     side of the other line there can't be an intersection.
+     If all four ccw are 0 the lines are collinear and they
+     intersect only if their extents overlap. Signs are
+     compared instead of multiplied so nothing overflows.
+                                                                     */
+    int d1 = sign(ccw(l1.p1, l1.p2, l2.p1)), d2 = sign(ccw(l1.p1, l1.p2, l2.p2));
+    int d3 = sign(ccw(l2.p1, l2.p2, l1.p1)), d4 = sign(ccw(l2.p1, l2.p2, l1.p2));
+
+    if (!d1 && !d2 && !d3 && !d4)
+        // collinear so check the extents overlap
+
+        return std::max(std::min(l1.p1.x, l1.p2.x), std::min(l2.p1.x, l2.p2.x)) <=
+               std::min(std::max(l1.p1.x, l1.p2.x), std::max(l2.p1.x, l2.p2.x)) &&
+               std::max(std::min(l1.p1.y, l1.p2.y), std::min(l2.p1.y, l2.p2.y)) <=
+               std::min(std::max(l1.p1.y, l1.p2.y), std::max(l2.p1.y, l2.p2.y));
+
+    return (d1 * d2 > 0 || d3 * d4 > 0) ? 0 : 1;
+}
@@ -1,22 +1,244 @@
 #include <iostream>
 #include <vector>
+#include <tuple>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
 #include <fstream>
 #include <sstream>
 #include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <immintrin.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using std::endl;
 using std::cout;
 
-struct Edge 
-{ 
-    int source, dest, weight; 
-    Edge(int source, int dest, int weight)
-            : source(source), dest(dest), weight(weight) {}
+// distances are 64 bit: INF marks a vertex not reached, NEG_INF one
+// reachable from a negative weight cycle, and sums saturate at FLOOR,
+// far below any simple path, so they can never wrap around
+const long long INF = LLONG_MAX;
+const long long NEG_INF = LLONG_MIN;
+const long long FLOOR = -(1LL << 62);
+
+inline long long saturate_add(long long distance, int weight)
+{ return std::max(distance + weight, FLOOR); }
+
+// Allocates arrays on 64 byte boundaries for vector loads
+template<typename T>
+struct AlignedAllocator
+{
+    typedef T value_type;
+    AlignedAllocator() {}
+    template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n);
+    void deallocate(T* p, size_t) { free(p); }
+    bool operator==(const AlignedAllocator&) const { return true; }
+    bool operator!=(const AlignedAllocator&) const { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// A read only view of edges held as separate arrays
+struct EdgeSpan
+{
+    const int *sources, *dests, *weights;
+    size_t count;
+};
+
+/*
+    The edges as separate aligned arrays of sources, destinations and
+    weights, so a pass over every edge streams each array once and
+    the vector kernels can load several edges in one instruction.
+                                                                    */
+struct EdgeList
+{
+    AlignedVector<int> sources, dests, weights;
+
+    size_t size() const { return sources.size(); }
+    void push(int source, int dest, int weight);
+    EdgeSpan span() const;
+};
+
+// Relaxes edges [begin, end) once and returns how many lowered a distance
+typedef size_t (*RelaxKernel)(long long* distance, const EdgeSpan& edges, 
+                              size_t begin, size_t end);
+
+// Header of a binary edge file. The sources, destinations and weights
+// follow as separate arrays of 32 bit integers, each starting on a 64
+// byte boundary
+struct EdgeFileHeader
+{
+    char magic[4];     // "EDGE"
+    uint32_t version;  // 1
+    uint64_t vertices;
+    uint64_t count;    // number of edges
+};
+
+// where array 0, 1 or 2 (sources, destinations, weights) starts in a
+// binary edge file, and with array 3 where the file ends
+inline size_t edge_array_offset(uint64_t count, int array)
+{ return 64 + array * ((count * sizeof(int) + 63) & ~(uint64_t)63); }
+
+/*
+    A binary edge file mapped read only. The edges are used in place,
+    so a pass pages them in as it goes and can drop them again once
+    relaxed, leaving only the distances resident.
+                                                                    */
+class EdgeFile
+{
+    void* mapping = nullptr;
+    size_t size = 0;
+    std::string filename;
+    void advise(size_t begin, size_t end, int advice, bool inward) const;
+
+public:
+    int vertices = 0;
+    EdgeSpan edges = {nullptr, nullptr, nullptr, 0};
+
+    explicit EdgeFile(const char* filename);
+    ~EdgeFile() { if (mapping) munmap(mapping, size); }
+    EdgeFile(const EdgeFile&) = delete;
+    EdgeFile& operator=(const EdgeFile&) = delete;
+
+    bool mapped() const { return mapping != nullptr; }
+    void read_ahead(size_t begin, size_t end) const { advise(begin, end, MADV_WILLNEED, false); }
+    void release(size_t begin, size_t end) const { advise(begin, end, MADV_DONTNEED, true); }
+
+    // stops the program unless every edge in [begin, end) joins two vertices of the graph
+    void check(size_t begin, size_t end) const;
+};
+
+/*
+    Edges grouped by source vertex. The edges of each vertex are split
+    into those going down to a lower vertex and those going up to the
+    same or a higher vertex, so a pass can follow Yen's ordering.
+                                                                    */
+struct Graph
+{
+    int vertices;
+    std::vector<int> offsets; // first edge of each vertex, then one past the last
+    std::vector<int> splits;  // first edge of each vertex going up
+    std::vector<int> targets;
+    std::vector<int> weights;
+    Graph(const EdgeList& graph, int vertices);
+};
+
+/*
+    The state of a worklist Bellman-Ford. Besides the vertices waiting
+    to be relaxed it keeps the shortest path tree as a preorder thread
+    (next, prev and depth), so the subtree of a vertex is the run of
+    vertices after it that are deeper than it. Vertices outside the
+    tree have depth -1.
+                                                                    */
+struct Worklist
+{
+    std::vector<char> up, down; // vertices whose up and down edges need relaxing
+    std::vector<int> parent, depth, next, prev;
+    std::vector<int> cycle;     // the first negative weight cycle found
+
+    Worklist(const std::vector<long long>& distance);
+    bool lower(int v, int u);
+    void cut(int v, std::vector<int>* removed = nullptr);
+    void unlink(int v);
+};
+
+// An edge given a new weight, inserted if missing, or erased
+struct EdgeUpdate
+{
+    int source, dest, weight;
+    bool erase;
 };
 
-std::tuple<std::vector<Edge>, int, int> readfile(char* filename);
-void bellman_ford(std::vector<int>& distance, std::vector<Edge>& graph, 
-                  int vertices, int edges);
+/*
+    Single source shortest paths kept up to date as edges change.
+    Parallel edges are merged into the lightest. The shortest path
+    tree is kept in a Worklist so a batch of updates only revisits
+    the subtrees below edges that got heavier or went away, and the
+    vertices reached through edges that got lighter.
+                                                                    */
+class DynamicPaths
+{
+    std::vector<std::vector<std::pair<int, int>>> out, in; // (vertex, weight)
+    int source;
+    std::vector<long long> distance;
+    Worklist work;
+    std::vector<int> queue;     // vertices whose out edges need relaxing
+    std::vector<int> negative;  // vertices at NEG_INF
+
+    // the distance of each vertex before the batch, for the vertices it touched
+    std::vector<long long> before;
+    std::vector<char> seen;
+    std::vector<int> touched;
+
+    void touch(int v);
+    void root();
+    void relax(int u, int v, int weight);
+    void propagate();
+    void unbounded(const std::vector<int>& cycle);
+    static int find(const std::vector<std::pair<int, int>>& edges, int v);
+
+public:
+    DynamicPaths(const EdgeList& graph, int vertices, int source);
+    std::vector<int> update(const std::vector<EdgeUpdate>& batch);
+    long long operator[](int v) const { return distance[v]; }
+    const std::vector<int>& cycle() const { return work.cycle; }
+};
+
+/*
+    A 4-ary min heap of (distance, vertex) pairs. Distances are never
+    decreased in place: a vertex is pushed again when its distance
+    drops and the stale entry is skipped when it is popped.
+                                                                    */
+class QuadHeap
+{
+    std::vector<std::pair<long long, int>> items;
+
+public:
+    bool empty() const { return items.empty(); }
+    void push(long long key, int vertex);
+    std::pair<long long, int> pop();
+};
+
+std::tuple<EdgeList, int, int> readfile(char* filename);
+void writefile(const char* filename, const EdgeList& graph, int vertices);
+void bellman_ford(std::vector<long long>& distance, const EdgeList& graph, 
+                  int vertices);
+bool stream_bellman_ford(std::vector<long long>& distance, const EdgeFile& file);
+size_t mark_unbounded(long long* distance, const EdgeSpan& edges, size_t begin, size_t end);
+RelaxKernel relax_kernel();
+size_t relax_scalar(long long* distance, const EdgeSpan& edges, size_t begin, size_t end);
+size_t relax_avx2(long long* distance, const EdgeSpan& edges, size_t begin, size_t end);
+size_t relax_avx512(long long* distance, const EdgeSpan& edges, size_t begin, size_t end);
+std::vector<int> shortest_paths(std::vector<long long>& distance, const Graph& graph);
+int relax(std::vector<long long>& distance, const Graph& graph, int u, int begin, 
+          int end, Worklist& work);
+void unbounded(std::vector<long long>& distance, const Graph& graph, Worklist& work, 
+               const std::vector<int>& cycle);
+std::vector<int> parallel_bellman_ford(std::vector<long long>& distance, 
+                                       const EdgeList& graph, 
+                                       int vertices, int threads);
+bool parent_cycle(const std::vector<int>& parent);
+void run_updates(const char* filename, DynamicPaths& paths, int vertices);
+void print_distance(int v, long long distance);
+std::vector<int> readsources(const char* filename, int vertices);
+void dijkstra(std::vector<long long>& distance, const Graph& graph, 
+              const std::vector<long long>* potential = nullptr);
+bool all_pairs(const Graph& graph, const std::vector<int>& sources, 
+               std::ostream& out, int threads);
+void delta_stepping(std::vector<long long>& distance, const Graph& graph, int threads);
+template<typename Task>
+void parallel_for(int tasks, int threads, Task task);
 
 int main(int argc, char** argv)
 {
@@ -27,24 +249,169 @@ int main(int argc, char** argv)
         exit(1);
     }
 
+    // --reference runs the original Bellman-Ford in place of the worklist
+    // and --threads sets the threads used by delta-stepping and the
+    // parallel Bellman-Ford
+    bool reference = argc > 2 && !strcmp(argv[2], "--reference");
+    // --all-pairs and --sources write a row of distances per source
+    // and --update applies batches of edge changes after solving once
+    bool every_source = argc > 2 && !strcmp(argv[2], "--all-pairs");
+    bool some_sources = argc > 2 && !strcmp(argv[2], "--sources");
+    bool update = argc > 2 && !strcmp(argv[2], "--update");
+    // --convert writes the graph to a binary edge file and --stream runs
+    // Bellman-Ford straight from one without loading it
+    bool convert = argc > 2 && !strcmp(argv[2], "--convert");
+    bool stream = argc > 2 && !strcmp(argv[2], "--stream");
+    int threads = argc > 2 && !strcmp(argv[2], "--threads")
+                  ? (argc > 3 ? atoi(argv[3]) : 0) : -1;
+
+    if (((every_source || update || convert) && argc < 4) || (some_sources && argc < 5))
+    {// ensure the output and source filenames are passed
+
+        cout << "ERROR! Expected " << (some_sources ? "source and output filenames" : "filename")
+             << " after " << argv[2] << endl;
+        exit(1);
+    }
+
+    if (!threads || threads < -1)
+    {// ensure a usable thread count is passed
+
+        cout << "ERROR! Expected a thread count of at least 1 after --threads" << endl;
+        exit(1);
+    }
+
     auto start = std::chrono::high_resolution_clock::now();
 
+    if (stream)
+    {// relax the mapped edges pass by pass, keeping only the distances
+
+        EdgeFile file(argv[1]);
+        if (!file.mapped())
+        {
+            cout << "ERROR! --stream expects a binary edge file, written by --convert" << endl;
+            exit(1);
+        }
+
+        std::vector<long long> distance(file.vertices, INF);
+        distance[0] = 0; // source to source is 0 weight
+
+        if (stream_bellman_ford(distance, file))
+            cout << "Graph contains a negative weight cycle" << endl;
+        for (int i = 0; i < file.vertices; i++)
+            print_distance(i, distance[i]);
+
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast
+                        <std::chrono::microseconds> (stop - start).count();
+
+        cout << "Program took " << duration << " microseconds" << endl;
+        return 0;
+    }
+
     // load graph
-    std::vector<Edge> graph;
+    EdgeList graph;
     int vertices = 0, edges = 0;
     std::tie(graph, vertices, edges) = readfile(argv[1]);
 
+    if (convert)
+    {// save the edges as a binary edge file
+
+        writefile(argv[3], graph, vertices);
+        cout << "Wrote " << graph.size() << " edges to " << argv[3] << endl;
+        return 0;
+    }
+
+    if (every_source || some_sources)
+    {// Johnson's algorithm from every source
+
+        std::vector<int> sources;
+        if (some_sources)
+            sources = readsources(argv[3], vertices);
+        else
+            for (int v = 0; v < vertices; v++)
+                sources.push_back(v);
+
+        const char* output = argv[some_sources ? 4 : 3];
+        std::ofstream file;
+        if (strcmp(output, "-")) file.open(output);
+        std::ostream& out = strcmp(output, "-") ? file : cout;
+
+        if (!all_pairs(Graph(graph, vertices), sources, out,
+                       std::max(1u, std::thread::hardware_concurrency())))
+        {
+            cout << "Graph contains a negative weight cycle" << endl;
+            exit(1);
+        }
+        out.flush();
+
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast
+                        <std::chrono::microseconds> (stop - start).count();
+
+        cout << "Wrote " << sources.size() << " rows to " << output << endl
+             << "Program took " << duration << " microseconds" << endl;
+        return 0;
+    }
+
+    if (update)
+    {// solve once, then repair the distances after each batch
+
+        DynamicPaths paths(graph, vertices, 0);
+        if (!paths.cycle().empty())
+            cout << "Graph contains a negative weight cycle" << endl;
+        for (int i = 0; i < vertices; i++)
+            print_distance(i, paths[i]);
+
+        run_updates(argv[3], paths, vertices);
+
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast
+                        <std::chrono::microseconds> (stop - start).count();
+
+        cout << "Updates took " << duration << " microseconds" << endl;
+        return 0;
+    }
+
     // initialise all distances as infinity
-    std::vector<int> distance(vertices, INT_MAX); 
+    std::vector<long long> distance(vertices, INF); 
     distance[0] = 0; // source to source is 0 weight
 
+    // without negative weights Dijkstra is used, and once the graph
+    // is large the work is spread across threads
+    bool negative = std::any_of(graph.weights.begin(), graph.weights.end(), 
+                                [](int weight) { return weight < 0; });
+    if (threads == -1)
+        threads = graph.size() >= (1 << 20) 
+                  ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+
     // perform Bellman-Ford
-    bellman_ford(distance, graph, vertices, edges);
+    if (reference)
+        bellman_ford(distance, graph, vertices);
+
+    else if (negative)
+    {
+        std::vector<int> cycle = threads > 1 
+                                 ? parallel_bellman_ford(distance, graph, vertices, threads)
+                                 : shortest_paths(distance, Graph(graph, vertices));
+        if (!cycle.empty())
+        {// print the first cycle found once
+
+            cout << "Graph contains a negative weight cycle:";
+            for (int v : cycle)
+                cout << " " << v;
+            cout << endl;
+        }
+    }
+
+    else if (threads > 1)
+        delta_stepping(distance, Graph(graph, vertices), threads);
+
+    else
+        dijkstra(distance, Graph(graph, vertices));
 
     // print distances
     for (int i = 0; i < vertices; i++)
-        cout << "Shortest Path from Source to Vertex " << i 
-             << " = " << distance[i] << endl;
+        print_distance(i, distance[i]);
 
     auto stop = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast
@@ -55,9 +422,32 @@ int main(int argc, char** argv)
     return 0;
 }
 
-std::tuple<std::vector<Edge>, int, int> readfile(char* filename)
-{// loads graph into data structure
-    std::vector<Edge> graph;
+void print_distance(int v, long long distance)
+{
+    cout << "Shortest Path from Source to Vertex " << v << " = ";
+    if (distance == NEG_INF)
+        cout << "-inf" << endl; // reachable from a negative weight cycle
+    else if (distance == INF)
+        cout << "inf" << endl;
+    else
+        cout << distance << endl;
+}
+
+std::tuple<EdgeList, int, int> readfile(char* filename)
+{// loads graph into data structure, from a binary edge file or text
+    EdgeList graph;
+
+    EdgeFile binary(filename);
+    if (binary.mapped())
+    {
+        const EdgeSpan& edges = binary.edges;
+        binary.check(0, edges.count);
+        graph.sources.assign(edges.sources, edges.sources + edges.count);
+        graph.dests.assign(edges.dests, edges.dests + edges.count);
+        graph.weights.assign(edges.weights, edges.weights + edges.count);
+        return std::make_tuple(std::move(graph), binary.vertices, (int)edges.count);
+    }
+
     std::ifstream file(filename);
     std::string line;
     int v = 0, e = 0;
@@ -69,34 +459,1198 @@ std::tuple<std::vector<Edge>, int, int> readfile(char* filename)
         std::stringstream linestream(line); 
         int s, d, w;
         if(!(linestream >> s >> d >> w)) continue; // handle whitespace after vertex/edge
-        graph.push_back(Edge(s, d, w));
+        graph.push(s, d, w);
+    }
+
+    return std::make_tuple(std::move(graph), v, e);
+}
+
+void writefile(const char* filename, const EdgeList& graph, int vertices)
+{/*
+    Writes a binary edge file: the header, then the sources,
+    destinations and weights arrays, each padded out to 64 bytes so
+    they can be mapped and loaded in place.
+                                                                    */
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
+
+    EdgeFileHeader header = {{'E', 'D', 'G', 'E'}, 1, (uint64_t)vertices, graph.size()};
+    char padding[64] = {};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(padding, 1, edge_array_offset(graph.size(), 0) - sizeof(header), file);
+
+    for (const AlignedVector<int>* array : {&graph.sources, &graph.dests, &graph.weights})
+    {
+        fwrite(array->data(), sizeof(int), array->size(), file);
+        fwrite(padding, 1, edge_array_offset(graph.size(), 1) - edge_array_offset(graph.size(), 0)
+                           - array->size() * sizeof(int), file);
+    }
+
+    if (fclose(file))
+    {
+        cout << "ERROR! Could not write " << filename << endl;
+        exit(1);
+    }
+}
+
+EdgeFile::EdgeFile(const char* filename)
+{/*
+    Maps a binary edge file. Anything else leaves the file unmapped,
+    so the caller can read it as text instead.
+                                                                    */
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0)
+    {// ensure the file can be read
+
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
+
+    EdgeFileHeader header;
+    size_t length = info.st_size;
+    if (length < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, "EDGE", 4))
+    {// not a binary edge file
+
+        close(fd);
+        return;
+    }
+
+    if (header.version != 1 || header.vertices == 0 || header.vertices > INT_MAX
+        || header.count > INT_MAX || length != edge_array_offset(header.count, 3))
+    {// ensure the header matches the file
+
+        cout << "ERROR! " << filename << " is not a valid binary edge file" << endl;
+        exit(1);
+    }
+
+    void* base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        cout << "ERROR! Could not map " << filename << endl;
+        exit(1);
+    }
+
+    // every pass reads the edges in order so let the kernel read ahead
+    madvise(base, length, MADV_SEQUENTIAL);
+
+    mapping = base;
+    size = length;
+    this->filename = filename;
+    vertices = header.vertices;
+    const char* bytes = (const char*)base;
+    edges = {(const int*)(bytes + edge_array_offset(header.count, 0)),
+             (const int*)(bytes + edge_array_offset(header.count, 1)),
+             (const int*)(bytes + edge_array_offset(header.count, 2)), header.count};
+}
+
+void EdgeFile::check(size_t begin, size_t end) const
+{/*
+    Checks the end points of edges [begin, end) before they are used
+    to index the distances. The check is made a range at a time, so a
+    file streamed in chunks is only read once for it.
+                                                                    */
+    for (size_t j = begin; j < end; j++)
+        if ((unsigned)edges.sources[j] >= (unsigned)vertices
+            || (unsigned)edges.dests[j] >= (unsigned)vertices)
+        {// ensure the edge is in the graph
+
+            cout << "ERROR! " << filename << " is not a valid binary edge file" << endl;
+            exit(1);
+        }
+}
+
+void EdgeFile::advise(size_t begin, size_t end, int advice, bool inward) const
+{/*
+    Gives the kernel advice about edges [begin, end) in each of the
+    three arrays. The range is widened to whole pages, or narrowed to
+    them when inward, so pages shared with the edges either side are
+    left alone.
+                                                                    */
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    for (const int* array : {edges.sources, edges.dests, edges.weights})
+    {
+        size_t first = (size_t)(array + begin), last = (size_t)(array + end);
+        first = inward ? (first + page - 1) / page * page : first / page * page;
+        last = inward ? last / page * page : (last + page - 1) / page * page;
+        if (first < last)
+            madvise((void*)first, last - first, advice);
+    }
+}
+
+std::vector<int> readsources(const char* filename, int vertices)
+{// loads a whitespace separated list of source vertices
+
+    std::vector<int> sources;
+    std::ifstream file(filename);
+    int v;
+
+    while (file >> v)
+    {
+        if (v < 0 || v >= vertices)
+        {// ensure every source is in the graph
+
+            cout << "ERROR! Source " << v << " is not a vertex" << endl;
+            exit(1);
+        }
+        sources.push_back(v);
+    }
+
+    return sources;
+}
+
+void run_updates(const char* filename, DynamicPaths& paths, int vertices)
+{/*
+    Applies an update file in batches. "+ source dest weight" inserts
+    an edge or sets its weight and "- source dest" erases it. A line
+    holding only "=" ends a batch, as does the end of the file, and
+    the distances the batch changed are printed.
+                                                                    */
+    std::ifstream file(filename);
+    if (!file)
+    {
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
     }
 
-    return {graph, v, e};
+    std::vector<EdgeUpdate> batch;
+    std::string line;
+    int batches = 0;
+
+    auto apply = [&]()
+    {
+        std::vector<int> changed = paths.update(batch);
+        batch.clear();
+
+        cout << "Batch " << ++batches << " changed " << changed.size() << " distances" << endl;
+        if (!paths.cycle().empty())
+        {
+            cout << "Graph contains a negative weight cycle:";
+            for (int v : paths.cycle())
+                cout << " " << v;
+            cout << endl;
+        }
+        for (int v : changed)
+            print_distance(v, paths[v]);
+    };
+
+    while (std::getline(file, line))
+    {// read updates inputed as op source dest weight
+
+        std::stringstream linestream(line);
+        std::string op;
+        EdgeUpdate edge = {0, 0, 0, false};
+        if (!(linestream >> op))
+            continue;
+
+        if (op == "=")
+        {
+            apply();
+            continue;
+        }
+
+        edge.erase = op == "-";
+        if ((op != "+" && op != "-") || !(linestream >> edge.source >> edge.dest)
+            || (op == "+" && !(linestream >> edge.weight))
+            || edge.source < 0 || edge.source >= vertices || edge.dest < 0 || edge.dest >= vertices)
+        {// ensure the update is valid
+
+            cout << "ERROR! Invalid update \"" << line << "\" in " << filename << endl;
+            exit(1);
+        }
+
+        batch.push_back(edge);
+    }
+
+    if (!batch.empty()) apply();
 }
 
-void bellman_ford(std::vector<int>& distance, std::vector<Edge>& graph, 
-                  int vertices, int edges)
+void bellman_ford(std::vector<long long>& distance, const EdgeList& graph, 
+                  int vertices)
 {
-    // Relax edges |V| - 1 times to get shortest path from src
+    RelaxKernel relax_edges = relax_kernel();
+
+    // Relax edges |V| - 1 times to get shortest path from src,
+    // stopping early once a pass changes nothing
     for (int i = 1; i <= vertices - 1; i++) 
 
-        for (int j = 0; j < edges; j++) 
+        if (!relax_edges(distance.data(), graph.span(), 0, graph.size()))
+            break;
+
+    // check for negative weight cycles, which a saturated distance
+    // also shows
+    for (size_t i = 0; i < graph.size(); i++)
+
+        if ((distance[graph.sources[i]] != INF
+             && saturate_add(distance[graph.sources[i]], graph.weights[i])
+             < distance[graph.dests[i]]) || distance[graph.dests[i]] == FLOOR)
+        {
+            cout << "Graph contains a negative weight cycle" << endl;
+            break;
+        }
+}
 
-            if (distance[graph[j].source] != INT_MAX 
-                && distance[graph[j].source] + graph[j].weight 
-                < distance[graph[j].dest])
+bool stream_bellman_ford(std::vector<long long>& distance, const EdgeFile& file)
+{/*
+    Bellman-Ford over a mapped binary edge file. Each pass walks the
+    edges in chunks, reading the next chunk ahead while the current
+    one is relaxed and releasing it after, so the edges never have to
+    fit in memory. The first pass also checks each chunk holds only
+    vertices of the graph before relaxing it. Passes stop once one changes nothing. If pass |V|
+    still changes a distance, or one saturated, the graph holds a
+    negative weight cycle and further passes spread NEG_INF from it.
+    Returns whether there was a cycle.
+                                                                    */
+    const size_t chunk = 1 << 20;
+    const EdgeSpan& edges = file.edges;
+    size_t checked = 0; // edges whose end points are known to be in the graph
 
-                distance[graph[j].dest] = distance[graph[j].source] 
-                + graph[j].weight;
+    auto pass = [&](RelaxKernel kernel)
+    {
+        size_t changed = 0;
+        for (size_t begin = 0; begin < edges.count; begin += chunk)
+        {
+            size_t end = std::min(begin + chunk, edges.count);
+            if (end > checked)
+            {// check each chunk the first time it is read
+                file.check(begin, end);
+                checked = end;
+            }
+            file.read_ahead(end, std::min(end + chunk, edges.count));
+            changed += kernel(distance.data(), edges, begin, end);
+            file.release(begin, end);
+        }
+        return changed;
+    };
 
-    // check for negative weight cycles
-    for (int i = 0; i < edges; i++)
+    RelaxKernel relax_edges = relax_kernel();
+    bool changed = true;
+    for (int i = 1; i <= file.vertices && changed; i++)
+        changed = pass(relax_edges);
 
-        if (distance[graph[i].source] != INT_MAX
-            && distance[graph[i].source] + graph[i].weight 
-            < distance[graph[i].dest])
+    if (!changed && std::find(distance.begin(), distance.end(), FLOOR) == distance.end())
+        return false;
 
-            cout << "Graph contains a negative weight cycle" << endl;
+    while (pass(mark_unbounded));
+    return true;
+}
+
+size_t mark_unbounded(long long* distance, const EdgeSpan& edges, size_t begin, size_t end)
+{/*
+    Sets the destination of edges [begin, end) to NEG_INF when the
+    edge could still be relaxed or leaves a vertex that is unbounded
+    already, and returns how many it set. Once the distances have
+    settled only vertices reachable from a negative weight cycle can
+    be marked.
+                                                                    */
+    size_t changed = 0;
+    for (size_t j = begin; j < end; j++)
+    {
+        long long from = distance[edges.sources[j]];
+        long long& to = distance[edges.dests[j]];
+        if (from == INF || to == NEG_INF)
+            continue;
+        if (from == NEG_INF || from == FLOOR || saturate_add(from, edges.weights[j]) < to)
+        {
+            to = NEG_INF;
+            changed++;
+        }
+    }
+    return changed;
+}
+
+RelaxKernel relax_kernel()
+{// picks the widest relaxation kernel the processor supports
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd")
+        && __builtin_cpu_supports("avx512vl"))
+        return relax_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return relax_avx2;
+    return relax_scalar;
+}
+
+size_t relax_scalar(long long* distance, const EdgeSpan& edges, size_t begin, size_t end)
+{
+    size_t changed = 0;
+    for (size_t j = begin; j < end; j++)
+    {
+        long long from = distance[edges.sources[j]];
+        if (from == INF) continue;
+
+        long long next = saturate_add(from, edges.weights[j]);
+        if (next < distance[edges.dests[j]])
+        {
+            distance[edges.dests[j]] = next;
+            changed++;
+        }
+    }
+
+    return changed;
+}
+
+__attribute__((target("avx2")))
+size_t relax_avx2(long long* distance, const EdgeSpan& edges, size_t begin, size_t end)
+{/*
+    Relaxes four edges at a time: the distances of their sources and
+    destinations are gathered, the weights added with saturation and
+    compared, and the lanes that improved are written back one by one
+    so two lanes with the same destination keep the lesser distance.
+                                                                    */
+    const __m256i inf = _mm256_set1_epi64x(INF), floor = _mm256_set1_epi64x(FLOOR);
+    size_t changed = 0, j = begin;
+
+    for (; j + 4 <= end; j += 4)
+    {
+        __m128i sources = _mm_loadu_si128((const __m128i*)&edges.sources[j]);
+        __m128i dests = _mm_loadu_si128((const __m128i*)&edges.dests[j]);
+        __m256i weights = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)&edges.weights[j]));
+
+        __m256i from = _mm256_i32gather_epi64(distance, sources, 8);
+        __m256i to = _mm256_i32gather_epi64(distance, dests, 8);
+        __m256i next = _mm256_add_epi64(from, weights);
+        next = _mm256_blendv_epi8(next, floor, _mm256_cmpgt_epi64(floor, next));
+
+        __m256i better = _mm256_andnot_si256(_mm256_cmpeq_epi64(from, inf),
+                                             _mm256_cmpgt_epi64(to, next));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(better));
+        if (!mask) continue;
+
+        alignas(32) long long lanes[4];
+        _mm256_store_si256((__m256i*)lanes, next);
+        for (; mask; mask &= mask - 1)
+        {
+            int k = __builtin_ctz(mask);
+            int v = edges.dests[j + k];
+            if (lanes[k] < distance[v])
+            {
+                distance[v] = lanes[k];
+                changed++;
+            }
+        }
+    }
+
+    return changed + relax_scalar(distance, edges, j, end);
+}
+
+__attribute__((target("avx512f,avx512cd,avx512vl")))
+size_t relax_avx512(long long* distance, const EdgeSpan& edges, size_t begin, size_t end)
+{/*
+    Relaxes eight edges at a time as relax_avx2 does, but scatters
+    the improved lanes in one instruction unless two of the eight
+    edges share a destination, which the conflict check picks out.
+                                                                    */
+    const __m512i inf = _mm512_set1_epi64(INF), floor = _mm512_set1_epi64(FLOOR);
+    size_t changed = 0, j = begin;
+
+    for (; j + 8 <= end; j += 8)
+    {
+        __m256i sources = _mm256_loadu_si256((const __m256i*)&edges.sources[j]);
+        __m256i dests = _mm256_loadu_si256((const __m256i*)&edges.dests[j]);
+        __m512i weights = _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i*)&edges.weights[j]));
+
+        __m512i from = _mm512_i32gather_epi64(sources, distance, 8);
+        __m512i to = _mm512_i32gather_epi64(dests, distance, 8);
+        __m512i next = _mm512_max_epi64(_mm512_add_epi64(from, weights), floor);
+
+        __mmask8 better = _mm512_cmpneq_epi64_mask(from, inf) & _mm512_cmplt_epi64_mask(next, to);
+        if (!better) continue;
+
+        if (!_mm256_test_epi32_mask(_mm256_maskz_conflict_epi32(better, dests), 
+                                    _mm256_set1_epi32(-1)))
+        {// every destination differs, so the lanes can be written at once
+
+            _mm512_mask_i32scatter_epi64(distance, better, dests, next, 8);
+            changed += __builtin_popcount(better);
+            continue;
+        }
+
+        alignas(64) long long lanes[8];
+        _mm512_store_si512(lanes, next);
+        for (int mask = better; mask; mask &= mask - 1)
+        {
+            int k = __builtin_ctz(mask);
+            int v = edges.dests[j + k];
+            if (lanes[k] < distance[v])
+            {
+                distance[v] = lanes[k];
+                changed++;
+            }
+        }
+    }
+
+    return changed + relax_scalar(distance, edges, j, end);
+}
+
+EdgeSpan EdgeList::span() const
+{ return {sources.data(), dests.data(), weights.data(), size()}; }
+
+void EdgeList::push(int source, int dest, int weight)
+{
+    sources.push_back(source);
+    dests.push_back(dest);
+    weights.push_back(weight);
+}
+
+template<typename T>
+T* AlignedAllocator<T>::allocate(size_t n)
+{
+    void* p = nullptr;
+    if (posix_memalign(&p, 64, n * sizeof(T))) throw std::bad_alloc();
+    return (T*)p;
+}
+
+Graph::Graph(const EdgeList& graph, int vertices)
+    : vertices(vertices), offsets(vertices + 1, 0), splits(vertices, 0),
+      targets(graph.size()), weights(graph.size())
+{// counting sort of the edges by source, with the down edges first
+
+    for (size_t i = 0; i < graph.size(); i++)
+    {
+        offsets[graph.sources[i] + 1]++;
+        if (graph.dests[i] < graph.sources[i]) splits[graph.sources[i]]++;
+    }
+
+    for (int v = 0; v < vertices; v++)
+    {
+        offsets[v + 1] += offsets[v];
+        splits[v] += offsets[v];
+    }
+
+    std::vector<int> down(offsets.begin(), offsets.end() - 1), up(splits);
+    for (size_t i = 0; i < graph.size(); i++)
+    {
+        int source = graph.sources[i];
+        int j = graph.dests[i] < source ? down[source]++ : up[source]++;
+        targets[j] = graph.dests[i];
+        weights[j] = graph.weights[i];
+    }
+}
+
+std::vector<int> shortest_paths(std::vector<long long>& distance, const Graph& graph)
+{/*
+    Worklist Bellman-Ford using Yen's ordering. Each pass sweeps the
+    vertices upwards relaxing their up edges, then downwards relaxing
+    their down edges, and only vertices whose distance changed since
+    their edges were last relaxed are visited. The search stops at
+    the first pass that changes nothing.
+
+    Negative weight cycles are found by Tarjan's subtree disassembly.
+    When a distance drops, the subtree below that vertex in the
+    shortest path tree is taken out of the tree and the worklist, as
+    its distances will drop again, and a cycle is closed exactly when
+    the vertex whose edge lowered the distance is in that subtree.
+    Every vertex reachable from a cycle is set to NEG_INF for minus
+    infinity and left out of the search. Returns the vertices of the
+    first cycle found in order, or nothing if there is none.
+                                                                    */
+    int n = graph.vertices;
+    Worklist work(distance);
+
+    for (;;)
+    {
+        int changed = 0;
+
+        for (int u = 0; u < n; u++)
+            if (work.up[u])
+            {
+                work.up[u] = 0;
+                changed += relax(distance, graph, u, graph.splits[u], 
+                                 graph.offsets[u + 1], work);
+            }
+
+        for (int u = n - 1; u >= 0; u--)
+            if (work.down[u])
+            {
+                work.down[u] = 0;
+                changed += relax(distance, graph, u, graph.offsets[u], 
+                                 graph.splits[u], work);
+            }
+
+        if (!changed) return work.cycle;
+    }
+}
+
+int relax(std::vector<long long>& distance, const Graph& graph, int u, int begin, 
+          int end, Worklist& work)
+{// relaxes edges [begin, end) of u and returns how many lowered a distance
+
+    int changed = 0;
+    for (int j = begin; j < end; j++)
+    {
+        int v = graph.targets[j];
+        long long next = saturate_add(distance[u], graph.weights[j]);
+        if (distance[v] == NEG_INF || next >= distance[v])
+            continue;
+
+        changed++;
+        if (!work.lower(v, u))
+        {// u is below v, so the edge closes a negative weight cycle
+
+            std::vector<int> cycle;
+            for (int w = u; w != v; w = work.parent[w])
+                cycle.push_back(w);
+            cycle.push_back(v);
+            std::reverse(cycle.begin(), cycle.end());
+
+            if (work.cycle.empty()) work.cycle = cycle;
+            unbounded(distance, graph, work, cycle);
+            break; // u is now unbounded too
+        }
+
+        distance[v] = next;
+    }
+
+    return changed;
+}
+
+void unbounded(std::vector<long long>& distance, const Graph& graph, Worklist& work, 
+               const std::vector<int>& cycle)
+{// sets every vertex reachable from cycle to minus infinity
+
+    std::vector<int> stack;
+    for (int v : cycle)
+    {
+        distance[v] = NEG_INF;
+        stack.push_back(v);
+    }
+
+    while (!stack.empty())
+    {
+        int u = stack.back();
+        stack.pop_back();
+        work.unlink(u);
+
+        for (int j = graph.offsets[u]; j < graph.offsets[u + 1]; j++)
+            if (distance[graph.targets[j]] != NEG_INF)
+            {
+                distance[graph.targets[j]] = NEG_INF;
+                stack.push_back(graph.targets[j]);
+            }
+    }
+}
+
+std::vector<int> parallel_bellman_ford(std::vector<long long>& distance, 
+                                       const EdgeList& graph, 
+                                       int vertices, int threads)
+{/*
+    Bellman-Ford across threads. The edges are grouped by destination
+    and each thread owns a contiguous range of destinations holding
+    about the same number of edges, pulling min(d(u) + w) into its
+    own vertices, so no two threads write the same distance and no
+    atomic read-modify-write is needed. Only edges out of vertices
+    lowered in this or the last pass are looked at, and a shared flag
+    ends the passes at the first one that changes nothing.
+
+    The edge that last lowered each vertex is kept, and a cycle of
+    these edges can only be a negative weight cycle. They are checked
+    for one after every power of two passes. On finding one, on a
+    distance saturating or on a change in pass V, the worklist search
+    is run instead to pick out the cycle and unbounded vertices.
+                                                                    */
+    int n = vertices;
+    Graph incoming(EdgeList{graph.dests, graph.sources, graph.weights}, n);
+
+    // the pass each vertex was last lowered in, -1 if it has no distance
+    std::vector<std::atomic<long long>> best(n);
+    std::vector<std::atomic<int>> lowered(n);
+    for (int v = 0; v < n; v++)
+    {
+        best[v].store(distance[v], std::memory_order_relaxed);
+        lowered[v].store(distance[v] == INF ? -1 : 0, std::memory_order_relaxed);
+    }
+
+    std::vector<int> parent(n, -1), bounds(threads + 1, n);
+    for (int t = 0; t < threads; t++)
+        bounds[t] = std::lower_bound(incoming.offsets.begin(), incoming.offsets.begin() + n,
+                                     (long long)incoming.targets.size() * t / threads)
+                    - incoming.offsets.begin();
+
+    for (int pass = 1; ; pass++)
+    {
+        std::atomic<bool> changed(false), saturated(false);
+
+        parallel_for(threads, threads, [&](int t)
+        {
+            bool lowered_any = false;
+            for (int v = bounds[t]; v < bounds[t + 1]; v++)
+            {
+                long long old = best[v].load(std::memory_order_relaxed), dv = old;
+                for (int j = incoming.offsets[v]; j < incoming.offsets[v + 1]; j++)
+                {
+                    int u = incoming.targets[j];
+                    if (lowered[u].load(std::memory_order_relaxed) < pass - 1) continue;
+
+                    long long next = saturate_add(best[u].load(std::memory_order_relaxed), 
+                                                  incoming.weights[j]);
+                    if (next < dv)
+                    {
+                        dv = next;
+                        parent[v] = u;
+                    }
+                }
+
+                if (dv < old)
+                {
+                    best[v].store(dv, std::memory_order_relaxed);
+                    lowered[v].store(pass, std::memory_order_relaxed);
+                    lowered_any = true;
+                    if (dv == FLOOR) saturated = true;
+                }
+            }
+
+            if (lowered_any) changed = true;
+        });
+
+        bool cycle = saturated || pass >= n 
+                     || (!(pass & (pass - 1)) && parent_cycle(parent));
+        if (changed && cycle) return shortest_paths(distance, Graph(graph, n));
+        if (changed) continue;
+
+        for (int v = 0; v < n; v++)
+            distance[v] = best[v].load(std::memory_order_relaxed);
+
+        return {};
+    }
+}
+
+bool parent_cycle(const std::vector<int>& parent)
+{// follows the parent of every vertex and returns true on meeting a cycle
+
+    int n = parent.size();
+    std::vector<int> seen(n, -1); // the vertex whose walk first reached each vertex
+
+    for (int v = 0; v < n; v++)
+        for (int w = v; w != -1; w = parent[w])
+        {
+            if (seen[w] == v) return true;
+            if (seen[w] != -1) break;
+            seen[w] = v;
+        }
+
+    return false;
+}
+
+Worklist::Worklist(const std::vector<long long>& distance)
+    : up(distance.size(), 0), down(distance.size(), 0), parent(distance.size(), -1),
+      depth(distance.size(), -1), next(distance.size(), -1), prev(distance.size(), -1)
+{// every vertex with a distance starts as the root of its own tree
+
+    for (size_t v = 0; v < distance.size(); v++)
+        if (distance[v] != INF)
+        {
+            up[v] = down[v] = 1;
+            depth[v] = 0;
+        }
+}
+
+bool Worklist::lower(int v, int u)
+{/*
+    Moves v below u in the tree after the edge (u, v) lowered the
+    distance of v. The old subtree of v is taken out of the tree
+    and the worklist. Returns false, changing nothing, if u is in
+    that subtree.
+                                                                    */
+    if (depth[v] >= 0)
+    {
+        if (v == u) return false;
+        for (int w = next[v]; w != -1 && depth[w] > depth[v]; w = next[w])
+            if (w == u) return false;
+
+        cut(v);
+    }
+
+    parent[v] = u;
+    depth[v] = depth[u] + 1;
+    prev[v] = u;
+    next[v] = next[u];
+    if (next[u] != -1) prev[next[u]] = v;
+    next[u] = v;
+    up[v] = down[v] = 1;
+
+    return true;
+}
+
+void Worklist::cut(int v, std::vector<int>* removed)
+{// takes v and its subtree out of the tree and the worklist
+
+    if (depth[v] < 0) return;
+
+    int after = next[v];
+    for (; after != -1 && depth[after] > depth[v];)
+    {
+        int following = next[after];
+        if (removed) removed->push_back(after);
+        up[after] = down[after] = 0;
+        parent[after] = depth[after] = next[after] = prev[after] = -1;
+        after = following;
+    }
+
+    if (removed) removed->push_back(v);
+    next[v] = after;
+    unlink(v);
+}
+
+void Worklist::unlink(int v)
+{// takes v alone out of the tree and the worklist
+
+    if (depth[v] >= 0)
+    {
+        if (prev[v] != -1) next[prev[v]] = next[v];
+        if (next[v] != -1) prev[next[v]] = prev[v];
+    }
+
+    up[v] = down[v] = 0;
+    parent[v] = depth[v] = next[v] = prev[v] = -1;
+}
+
+DynamicPaths::DynamicPaths(const EdgeList& graph, int vertices, int source)
+    : out(vertices), in(vertices), source(source), distance(vertices, INF), 
+      work(distance), before(vertices), seen(vertices, 0)
+{// merges parallel edges into the lightest and solves from source
+
+    std::vector<size_t> order(graph.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return std::make_tuple(graph.sources[a], graph.dests[a], graph.weights[a])
+               < std::make_tuple(graph.sources[b], graph.dests[b], graph.weights[b]);
+    });
+
+    for (size_t k = 0; k < order.size(); k++)
+    {
+        size_t i = order[k];
+        if (k && graph.sources[i] == graph.sources[order[k - 1]]
+              && graph.dests[i] == graph.dests[order[k - 1]]) continue;
+
+        out[graph.sources[i]].push_back({graph.dests[i], graph.weights[i]});
+        in[graph.dests[i]].push_back({graph.sources[i], graph.weights[i]});
+    }
+
+    root();
+    propagate();
+
+    for (int v : touched)
+        seen[v] = 0;
+    touched.clear();
+}
+
+std::vector<int> DynamicPaths::update(const std::vector<EdgeUpdate>& batch)
+{/*
+    Applies a batch of edge changes and repairs the distances,
+    returning the vertices whose distance changed. In the style of
+    Ramalingam and Reps, the subtree below each tree edge that got
+    heavier or was erased is cut from the shortest path tree and set
+    to infinity, along with any vertices left at minus infinity by an
+    earlier cycle. Each cut vertex is then reseeded from its incoming
+    edges, the edges that got lighter lower their destinations, and
+    the worklist carries the changes on from there, still finding
+    any negative weight cycle the batch closed.
+                                                                    */
+    std::vector<int> cuts, lighter, removed;
+    work.cycle.clear();
+
+    for (auto& edge : batch)
+    {
+        int u = edge.source, v = edge.dest;
+        int j = find(out[u], v), k = find(in[v], u);
+        if (j < 0 && edge.erase) continue; // nothing to erase
+
+        if (j >= 0 && (edge.erase || edge.weight > out[u][j].second) && work.parent[v] == u)
+            cuts.push_back(v); // a tree edge got heavier
+        if (!edge.erase && (j < 0 || edge.weight < out[u][j].second))
+            lighter.push_back(u);
+
+        if (edge.erase)
+        {
+            out[u][j] = out[u].back();
+            out[u].pop_back();
+            in[v][k] = in[v].back();
+            in[v].pop_back();
+        }
+
+        else if (j >= 0)
+            out[u][j].second = in[v][k].second = edge.weight;
+
+        else
+        {
+            out[u].push_back({v, edge.weight});
+            in[v].push_back({u, edge.weight});
+        }
+    }
+
+    // cut the subtrees and the vertices left unbounded
+    for (int v : cuts)
+        work.cut(v, &removed);
+    removed.insert(removed.end(), negative.begin(), negative.end());
+    negative.clear();
+
+    for (int v : removed)
+    {
+        touch(v);
+        distance[v] = INF;
+    }
+    if (distance[source] == INF) root();
+
+    for (int v : removed)
+        for (auto& edge : in[v])
+            relax(edge.first, v, edge.second);
+
+    for (int u : lighter)
+        for (auto& edge : out[u])
+            relax(u, edge.first, edge.second);
+
+    propagate();
+
+    std::vector<int> changed;
+    for (int v : touched)
+    {
+        if (distance[v] != before[v]) changed.push_back(v);
+        seen[v] = 0;
+    }
+    touched.clear();
+
+    std::sort(changed.begin(), changed.end());
+    return changed;
+}
+
+void DynamicPaths::touch(int v)
+{// remembers the distance of v before the batch
+
+    if (seen[v]) return;
+    seen[v] = 1;
+    before[v] = distance[v];
+    touched.push_back(v);
+}
+
+void DynamicPaths::root()
+{// puts the source back at the root of the tree
+
+    distance[source] = 0;
+    work.depth[source] = 0;
+    work.up[source] = 1;
+    queue.push_back(source);
+}
+
+void DynamicPaths::relax(int u, int v, int weight)
+{// relaxes the edge (u, v), queueing v if it lowers its distance
+
+    // u is out of the tree when it has no distance or one about to drop
+    if (work.depth[u] < 0 || distance[v] == NEG_INF)
+        return;
+
+    long long next = saturate_add(distance[u], weight);
+    if (next >= distance[v]) return;
+
+    bool queued = work.up[v];
+    if (!work.lower(v, u))
+    {// u is below v, so the edge closes a negative weight cycle
+
+        std::vector<int> cycle;
+        for (int w = u; w != v; w = work.parent[w])
+            cycle.push_back(w);
+        cycle.push_back(v);
+        std::reverse(cycle.begin(), cycle.end());
+
+        if (work.cycle.empty()) work.cycle = cycle;
+        unbounded(cycle);
+        return;
+    }
+
+    touch(v);
+    distance[v] = next;
+    if (!queued) queue.push_back(v);
+}
+
+void DynamicPaths::propagate()
+{// relaxes the out edges of queued vertices first in first out
+
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        int u = queue[i];
+        if (!work.up[u]) continue; // cut from the tree since it was queued
+        work.up[u] = 0;
+
+        for (auto& edge : out[u])
+            relax(u, edge.first, edge.second);
+    }
+
+    queue.clear();
+}
+
+void DynamicPaths::unbounded(const std::vector<int>& cycle)
+{// sets every vertex reachable from cycle to minus infinity
+
+    std::vector<int> stack;
+    for (int v : cycle)
+    {
+        touch(v);
+        distance[v] = NEG_INF;
+        stack.push_back(v);
+    }
+
+    while (!stack.empty())
+    {
+        int u = stack.back();
+        stack.pop_back();
+        work.unlink(u);
+        negative.push_back(u);
+
+        for (auto& edge : out[u])
+            if (distance[edge.first] != NEG_INF)
+            {
+                touch(edge.first);
+                distance[edge.first] = NEG_INF;
+                stack.push_back(edge.first);
+            }
+    }
+}
+
+int DynamicPaths::find(const std::vector<std::pair<int, int>>& edges, int v)
+{// the index of the edge to v, or -1 if there is none
+
+    for (size_t j = 0; j < edges.size(); j++)
+        if (edges[j].first == v) return j;
+    return -1;
+}
+
+void dijkstra(std::vector<long long>& distance, const Graph& graph, 
+              const std::vector<long long>* potential)
+{/*
+    Dijkstra over a 4-ary heap, for graphs with no negative weights
+    or, given Johnson potentials h, for edges reweighted to
+    w(u, v) + h(u) - h(v).
+                                                                    */
+    QuadHeap heap;
+    for (int v = 0; v < graph.vertices; v++)
+        if (distance[v] != INF) heap.push(distance[v], v);
+
+    while (!heap.empty())
+    {
+        std::pair<long long, int> top = heap.pop();
+        int u = top.second;
+        if (top.first != distance[u]) continue; // stale entry
+
+        for (int j = graph.offsets[u]; j < graph.offsets[u + 1]; j++)
+        {
+            int v = graph.targets[j];
+            long long next = distance[u] + graph.weights[j];
+            if (potential) next += (*potential)[u] - (*potential)[v];
+
+            if (next < distance[v])
+            {
+                distance[v] = next;
+                heap.push(next, v);
+            }
+        }
+    }
+}
+
+bool all_pairs(const Graph& graph, const std::vector<int>& sources, 
+               std::ostream& out, int threads)
+{/*
+    Johnson's algorithm. Starting every vertex at distance 0 is the
+    same as adding a virtual source with a zero weight edge to every
+    vertex, so one worklist Bellman-Ford gives potentials h with
+    w(u, v) + h(u) - h(v) never negative. Dijkstra then runs from each
+    source over the reweighted edges on a pool of threads, a block of
+    rows at a time, and each block is written in source order as
+    "source d0 d1 ..." with "inf" for unreachable vertices. Returns
+    false if there is a negative weight cycle.
+                                                                    */
+    int n = graph.vertices;
+    std::vector<long long> potential(n, 0);
+    if (!shortest_paths(potential, graph).empty()) return false;
+
+    int block = threads * 16;
+    std::vector<std::string> rows(block);
+
+    for (size_t first = 0; first < sources.size(); first += block)
+    {
+        int count = std::min<size_t>(block, sources.size() - first);
+
+        parallel_for(count, threads, [&](int i)
+        {
+            int source = sources[first + i];
+            std::vector<long long> distance(n, INF);
+            distance[source] = 0;
+            dijkstra(distance, graph, &potential);
+
+            std::string& row = rows[i];
+            row = std::to_string(source);
+            for (int v = 0; v < n; v++)
+            {
+                row += ' ';
+                row += distance[v] == INF ? "inf"
+                       : std::to_string(distance[v] - potential[source] + potential[v]);
+            }
+            row += '\n';
+        });
+
+        for (int i = 0; i < count; i++)
+            out << rows[i];
+    }
+
+    return true;
+}
+
+void delta_stepping(std::vector<long long>& distance, const Graph& graph, int threads)
+{/*
+    Parallel delta-stepping for graphs with no negative weights.
+    Vertices wait in buckets of distances delta wide. The lowest
+    bucket is emptied by relaxing the light edges (weight at most
+    delta) of its vertices across threads, which may refill it, and
+    then the heavy edges of every vertex it held are relaxed once.
+    Distances are lowered with a compare and swap so threads can
+    relax edges into the same vertex. Delta is the largest weight
+    over the average degree, and frontiers too small to be worth
+    the threads are relaxed on the calling thread.
+                                                                    */
+    int n = graph.vertices;
+    long long degree = std::max<long long>(1, graph.targets.size() / std::max(1, n));
+    int max_weight = 0;
+    for (int weight : graph.weights)
+        max_weight = std::max(max_weight, weight);
+    long long delta = std::max<long long>(1, max_weight / degree);
+
+    std::vector<std::atomic<long long>> best(n);
+    std::map<long long, std::vector<int>> buckets;
+    for (int v = 0; v < n; v++)
+    {
+        best[v].store(distance[v], std::memory_order_relaxed);
+        if (distance[v] != INF) buckets[distance[v] / delta].push_back(v);
+    }
+
+    // vertices each thread lowered, filed into buckets after each step
+    std::vector<std::vector<int>> lowered(threads);
+
+    auto relax_all = [&](const std::vector<int>& frontier, bool light)
+    {
+        int tasks = frontier.size() < 1024 ? 1 : threads;
+        parallel_for(tasks, tasks, [&](int t)
+        {
+            size_t begin = frontier.size() * t / tasks;
+            size_t end = frontier.size() * (t + 1) / tasks;
+            for (size_t i = begin; i < end; i++)
+            {
+                int u = frontier[i];
+                long long du = best[u].load(std::memory_order_relaxed);
+
+                for (int j = graph.offsets[u]; j < graph.offsets[u + 1]; j++)
+                {
+                    if ((graph.weights[j] <= delta) != light) continue;
+
+                    int v = graph.targets[j];
+                    long long next = du + graph.weights[j];
+                    long long old = best[v].load(std::memory_order_relaxed);
+                    while (next < old && !best[v].compare_exchange_weak(old, next));
+                    if (next < old) lowered[t].push_back(v);
+                }
+            }
+        });
+
+        for (auto& vertices : lowered)
+        {
+            for (int v : vertices)
+                buckets[best[v].load(std::memory_order_relaxed) / delta].push_back(v);
+            vertices.clear();
+        }
+    };
+
+    while (!buckets.empty())
+    {
+        long long index = buckets.begin()->first;
+        std::vector<int> settled;
+
+        while (!buckets.empty() && buckets.begin()->first == index)
+        {// relax light edges until the bucket stays empty
+
+            std::vector<int> frontier;
+            for (int v : buckets.begin()->second)
+                if (best[v].load(std::memory_order_relaxed) / delta == index)
+                    frontier.push_back(v); // skip vertices since lowered into an earlier bucket
+            buckets.erase(buckets.begin());
+
+            std::sort(frontier.begin(), frontier.end());
+            frontier.erase(std::unique(frontier.begin(), frontier.end()), frontier.end());
+            relax_all(frontier, true);
+            settled.insert(settled.end(), frontier.begin(), frontier.end());
+        }
+
+        std::sort(settled.begin(), settled.end());
+        settled.erase(std::unique(settled.begin(), settled.end()), settled.end());
+        relax_all(settled, false);
+    }
+
+    for (int v = 0; v < n; v++)
+        distance[v] = best[v].load(std::memory_order_relaxed);
 }
 
+void QuadHeap::push(long long key, int vertex)
+{
+    int i = items.size();
+    items.push_back({key, vertex});
+
+    for (int parent = (i - 1) / 4; i > 0 && key < items[parent].first; parent = (i - 1) / 4)
+    {
+        items[i] = items[parent];
+        i = parent;
+    }
+
+    items[i] = {key, vertex};
+}
+
+std::pair<long long, int> QuadHeap::pop()
+{// removes and returns the entry with the least distance
+
+    std::pair<long long, int> top = items[0];
+    std::pair<long long, int> last = items.back();
+    items.pop_back();
+    if (items.empty()) return top;
+
+    int i = 0, n = items.size();
+    for (;;)
+    {
+        int least = -1;
+        for (int c = 4 * i + 1; c <= 4 * i + 4 && c < n; c++)
+            if (items[c].first < (least < 0 ? last.first : items[least].first))
+                least = c;
+        if (least < 0) break;
+
+        items[i] = items[least];
+        i = least;
+    }
+
+    items[i] = last;
+    return top;
+}
+
+template<typename Task>
+void parallel_for(int tasks, int threads, Task task)
+{/*
+    Runs task(0) to task(tasks - 1) on a pool of threads. Each
+    thread takes the next task index until none are left.
+                                                                    */
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int i = next++; i < tasks; i = next++)
+            task(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < std::min(tasks, threads); t++)
+        pool.push_back(std::thread(worker));
+
+    worker();
+    for (auto& thread : pool)
+        thread.join();
+}
@@ -1,161 +1,1501 @@
 #include <iostream>
-#include <set>
-#include <map>
+#include <vector>
+#include <algorithm>
 #include <fstream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <immintrin.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using std::cout;
 using std::endl;
 
+// How the neighbours of a vertex are kept, chosen by its degree: the
+// sorted neighbours, the sorted vertices that are not neighbours, or a
+// bit per vertex of the graph
+enum RowKind : uint8_t { ARRAY, COMPLEMENT, BITMAP };
+
+// Sets bit index[i] of results for each of count probes whose bit us[i] is
+// set in a bitmap row
+typedef void (*BitmapProbe)(const uint64_t *row, const int *us, const uint32_t *index,
+                            size_t count, uint64_t *results);
+
+/*
+    A sorted list of vertices packed in blocks of 128. The list
+    starts with the first vertex of each block, a word each, then
+    holds every vertex as its offset from the first of its block in
+    width bits, so any vertex can be read without decoding those
+    before it.
+                                                                */
+struct PackedList
+{
+    const uint64_t *bases = nullptr, *packed = nullptr;
+    int count = 0, width = 0;
+
+    PackedList() {}
+    PackedList(const uint64_t *start, int count, int width)
+        : bases(start), packed(start + blocks(count)), count(count), width(width) {}
+
+    int operator[](int i) const
+    {
+        if (!width)
+            return bases[i / 128];
+        size_t bit = (size_t)i * width;
+        uint64_t offset = packed[bit / 64] >> (bit % 64);
+        if (bit % 64 + width > 64)
+            offset |= packed[bit / 64 + 1] << (64 - bit % 64);
+        return bases[i / 128] + (offset & ((1ull << width) - 1));
+    }
+
+    bool contains(int u) const;
+
+    static int blocks(int count) { return (count + 127) / 128; }
+    static size_t words(int count, int width)
+    { return blocks(count) + ((size_t)count * width + 63) / 64; }
+
+    // the bits each offset of a sorted list needs, and packing it into zeroed words
+    static int fit(const int *values, int count);
+    static void write(const int *values, int count, int width, uint64_t *out);
+};
+
+/*
+    The neighbours of a vertex read in place. An array row is read
+    straight through, a complement row by counting through the
+    vertices and skipping those it lists, and a bitmap row one set
+    bit at a time, so nothing is allocated or copied.
+                                                                */
+class Neighbours
+{
+public:
+    class iterator
+    {
+        RowKind kind = ARRAY;
+        PackedList list; // array and complement rows
+        int index = 0;   // the next vertex of list
+        const uint64_t *first = nullptr, *word = nullptr, *last = nullptr; // bitmap rows
+        uint64_t bits = 0; // the bits of word not visited yet
+        int vertex = 0;    // complement rows: the next neighbour
+
+        // move to the next word holding a set bit, or the end of the row
+        void skip() { while (!bits && word < last) bits = ++word < last ? *word : 0; }
+
+        // move past the vertices the complement row lists
+        void pass() { for (; index < list.count && list[index] == vertex; index++) vertex++; }
+
+    public:
+        iterator() {}
+        iterator(const PackedList &list, int index) : list(list), index(index) {}
+        iterator(const PackedList &list, int index, int vertex)
+            : kind(COMPLEMENT), list(list), index(index), vertex(vertex)
+        { pass(); }
+        iterator(const uint64_t *first, const uint64_t *word, const uint64_t *last)
+            : kind(BITMAP), first(first), word(word), last(last), bits(word < last ? *word : 0)
+        { skip(); }
+
+        int operator*() const
+        {
+            if (kind == ARRAY)
+                return list[index];
+            if (kind == COMPLEMENT)
+                return vertex;
+            return (word - first) * 64 + __builtin_ctzll(bits);
+        }
+
+        iterator &operator++()
+        {
+            if (kind == ARRAY)
+                index++;
+            else if (kind == COMPLEMENT)
+            {
+                vertex++;
+                pass();
+            }
+            else
+            {
+                bits &= bits - 1;
+                skip();
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator &other) const
+        {
+            return index == other.index && word == other.word && bits == other.bits
+                   && vertex == other.vertex;
+        }
+        bool operator!=(const iterator &other) const { return !(*this == other); }
+    };
+
+    Neighbours() {}
+    Neighbours(iterator first, iterator last) : first(first), last(last) {}
+    iterator begin() const { return first; }
+    iterator end() const { return last; }
+    bool empty() const { return first == last; }
+
+private:
+    iterator first, last;
+};
+
 class EfficientAdjacencyList
 {
-    // structure to hold the adjacency list
-    std::map<int, std::set<int>> adj_list;
+    /*
+        Each vertex keeps its neighbours in whichever container is
+        smallest for its degree. Every row points into one array
+        of words: a bitmap row holds a bit per vertex, bit u set
+        when there is an edge to u, and array and complement rows
+        are packed lists. The rows and words are laid out as in a
+        binary adjacency file, so a mapped file is used in place.
+                                                                */
+    struct Row
+    {
+        uint64_t start; // first word of the row
+        int32_t degree;
+        RowKind kind;
+        uint8_t width;  // bits per vertex of a packed list
+    };
+    static_assert(sizeof(Row) == 16, "rows are mapped from binary files");
+    const Row *rows = nullptr;
+    const uint64_t *data = nullptr;
+    size_t data_words = 0;
+    size_t words = 0; // 64 bit words per bitmap row
+
+    // the rows and words of a graph read from text, or the file they are mapped from
+    std::vector<Row> row_store;
+    std::vector<uint64_t> data_store;
+    void *mapping = nullptr;
+    size_t mapped = 0;
 
     // variables relating to individual graphs
     int edges = 0, vertices = 0;
-    double density = 0.;
-    bool sparse = false;
 
-    // construct a sparse graph
-    void construct_sparse(std::ifstream &file);
-    
-    // construct a dense graph
-    void construct_dense(std::ifstream &file, double vertices);
+    // map a binary adjacency file, returning false if filename is not one
+    bool map(const char *filename, int fd, size_t size);
+
+    // returns if a mapped row can be read safely
+    bool valid(const Row &row) const;
+
+    // the packed list of an array or complement row
+    PackedList list(const Row &row) const
+    {
+        return PackedList(data + row.start, row.kind == ARRAY ? row.degree : vertices - row.degree,
+                          row.width);
+    }
+
+    // construct the rows from the edges list_edges(add) passes to add(t, v, u)
+    template<typename Edges>
+    void construct(Edges list_edges, int threads);
+
+    // calls add(t, v, u) for every edge, thread t reading one slice of the lines
+    template<typename Add>
+    void read_edges(const char *begin, const char *end, int threads, Add add) const;
 
 public:
 
-    // determine graph and appropriately load based on density
+    EfficientAdjacencyList() {}
+    ~EfficientAdjacencyList() { if (mapping) munmap(mapping, mapped); }
+    EfficientAdjacencyList(const EfficientAdjacencyList &) = delete;
+    EfficientAdjacencyList &operator=(const EfficientAdjacencyList &) = delete;
+
+    // load the graph, picking a container for each vertex
     void determine(char* filename);
 
-    // returns if vertex v is ocnnected to u
-    bool connected(int v, int u);
+    // load every edge of graph reversed, and also as it is when undirected
+    void transpose(const EfficientAdjacencyList &graph, bool undirected);
+
+    // save the graph as a binary adjacency file
+    void write(const char *filename) const;
+
+    // returns if vertex v is connected to u
+    bool connected(int v, int u) const;
+
+    // sets bit i of results when v[i] is connected to u[i], for count queries
+    void connected(const int *v, const int *u, size_t count, uint64_t *results,
+                   int threads) const;
+
+    // returns the neighbours of v, read in place
+    Neighbours get_neighbours(int v) const;
+
+    // returns the number of neighbours of v
+    int degree(int v) const;
+
+    // returns if any neighbour of v has its bit set in a bitmap of the vertices
+    bool meets(int v, const uint64_t *set) const;
+
+    // returns the number of vertices
+    int size() const { return vertices; }
+};
+
+// Header of a binary adjacency file, followed by the row of each vertex
+// and then the words the rows point into
+struct AdjacencyFileHeader
+{
+    char magic[4];     // "ADJL"
+    uint32_t version;  // 1
+    uint64_t vertices;
+    uint64_t edges;
+    uint64_t words;    // number of words after the rows
+};
+
+// An edge added to or erased from a graph in a batch of edits
+struct EdgeEdit
+{
+    int v, u;
+    bool erase;
+};
+
+class ConcurrentAdjacencyList
+{
+    /*
+        A graph that can be edited while other threads read it.
+        Each row is an immutable version in the same containers
+        as EfficientAdjacencyList. An edit builds a new version
+        of the row and swaps the row to it, so readers see the
+        whole old row or the whole new one and never lock.
+        Instead a reader announces the epoch it started in, and
+        a replaced version is freed once every reader has moved
+        past the epoch it was replaced in. Writers take turns.
+                                                                */
+    struct Version
+    {
+        int degree;
+        RowKind kind;
+        uint8_t width;              // bits per vertex of a packed list
+        std::vector<uint64_t> data; // the bitmap or packed list
+    };
+
+    // the epoch each reader started in, or 0 outside a read, a cache line apiece
+    struct ReaderSlot
+    {
+        std::atomic<uint64_t> epoch{0};
+        char padding[56];
+    };
+    static const int readers = 256;
+
+    int vertices = 0;
+    size_t words = 0; // 64 bit words per bitmap row
+    std::unique_ptr<std::atomic<const Version *>[]> rows;
+    std::unique_ptr<ReaderSlot[]> slots;
+    std::atomic<uint64_t> epoch{1};
+
+    // replaced versions and the epoch they were replaced in, guarded by writer
+    std::mutex writer;
+    std::vector<std::pair<const Version *, uint64_t>> retired;
+
+    // marks the calling thread as reading for as long as it lives
+    class ReadGuard
+    {
+        std::atomic<uint64_t> &slot;
+        bool outer; // reads may nest, and only the outermost announces
+
+    public:
+        explicit ReadGuard(const ConcurrentAdjacencyList &graph)
+            : slot(graph.slots[reader_slot()].epoch), outer(!slot.load(std::memory_order_relaxed))
+        { if (outer) slot.store(graph.epoch.load()); }
+        ~ReadGuard() { if (outer) slot.store(0, std::memory_order_release); }
+    };
+
+    // the slot of the calling thread, claimed on its first read and freed when it exits
+    static int reader_slot();
+
+    // a new version holding the sorted neighbours, in the container their count calls for
+    const Version *build(const std::vector<int> &neighbours) const;
+
+    // the neighbours of a version, read in place
+    Neighbours range(const Version &row) const;
+
+    // free the replaced versions no reader can still hold
+    void reclaim();
+
+public:
 
-    // returns the list of neighbours to v
-    std::set<int> get_neighbours(int v);
+    explicit ConcurrentAdjacencyList(const EfficientAdjacencyList &graph);
+    ~ConcurrentAdjacencyList();
+    ConcurrentAdjacencyList(const ConcurrentAdjacencyList &) = delete;
+    ConcurrentAdjacencyList &operator=(const ConcurrentAdjacencyList &) = delete;
+
+    // apply count edits in order, returning how many rows changed
+    size_t apply(const EdgeEdit *edits, size_t count);
+
+    // returns if vertex v is connected to u
+    bool connected(int v, int u) const;
+
+    // calls visit(u) for each neighbour u of v, all from one version of the row
+    template<typename Visit>
+    void neighbours(int v, Visit visit) const
+    {
+        if (v < 0 || v >= vertices)
+            return;
+        ReadGuard guard(*this);
+        for (int u : range(*rows[v].load()))
+            visit(u);
+    }
+
+    // returns the number of neighbours of v
+    int degree(int v) const;
+
+    // returns the number of vertices
+    int size() const { return vertices; }
 };
 
+class BreadthFirstSearch
+{
+    /*
+        Breadth first search that changes direction as the
+        frontier grows and shrinks (Beamer's direction optimising
+        search). A small frontier is a list of vertices whose
+        edges are followed top down. Once the edges leaving the
+        frontier outnumber a share of those not yet explored,
+        every unvisited vertex instead looks for a neighbour in
+        the frontier through the reversed graph, the frontier
+        kept as a bitmap so a bitmap row is checked a word at a
+        time. Both steps are shared by all threads.
+                                                                */
+    const EfficientAdjacencyList &graph, &reversed;
+    int threads;
+    std::vector<uint64_t> visited, frontier, next; // a bit per vertex
+    std::vector<int> queue;    // the frontier of a top down step
+    long long unexplored = 0;  // edges leaving vertices not visited yet
+
+    // visit the vertices reachable from source that no earlier search visited,
+    // returning the number of levels
+    int search(int source, int *depth, int *root);
+
+    // grow the next level of the search, returning the edges leaving it
+    long long top_down(int level, int *depth, int *root, int source);
+    long long bottom_up(int level, int *depth, int *root, int source, size_t &found);
+
+public:
+
+    // reversed must hold every edge of graph turned around, or graph itself when undirected
+    BreadthFirstSearch(const EfficientAdjacencyList &graph, const EfficientAdjacencyList &reversed,
+                       int threads);
+
+    // sets depth[v] to the fewest edges from source to v, or -1, returning the number of levels
+    int distances(int source, std::vector<int> &depth);
+
+    // labels every vertex with the smallest vertex it is connected to, returning the number
+    // of components, for an undirected graph
+    int components(std::vector<int> &component);
+};
+
+RowKind row_kind(long long degree, int vertices);
+int read_line(const char *&pos, const char *end, long long *values);
+void readqueries(const char *filename, std::vector<int> &v, std::vector<int> &u);
+void run_updates(const char *filename, ConcurrentAdjacencyList &graph);
+BitmapProbe bitmap_probe();
+void probe_scalar(const uint64_t *row, const int *us, const uint32_t *index, size_t count,
+                  uint64_t *results);
+void probe_avx2(const uint64_t *row, const int *us, const uint32_t *index, size_t count,
+                uint64_t *results);
+template<typename Task>
+void parallel_for(int tasks, int threads, Task task);
+
 void EfficientAdjacencyList::determine(char* filename)
-{/* 
-        This function takes the file passed from the 
-        command line and determines what type of graph
-        is needed. It determines density which we then
-        use to construct an adjancy list for either a
-        sparse or dense graph.
+{/*
+        This function takes the file passed from the
+        command line and loads the graph, choosing how to
+        keep the neighbours of each vertex from its own
+        degree. The file is memory mapped and parsed once by
+        all threads together, and the rows are built from the
+        edges parsed. A binary adjacency file is mapped and
+        used in place instead.
                                                             */
 
-    std::ifstream file(filename);
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0)
+    {// ensure the file can be read
 
-    // read number of vertices and edges
-    file >> vertices >> edges;
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
 
-    // calculate density
-    density = edges / (vertices * (vertices - 1));
+    size_t size = info.st_size;
+    if (map(filename, fd, size))
+        return;
 
-    /*
-        we have a sparse graph is density is less than 0.5
-        we have a dense graph otherwise                     
-                                                            */ 
-    if (density < 0.5)
-        construct_sparse(file);
+    const char *text = size ? (const char *)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                            : nullptr;
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        cout << "ERROR! Could not map " << filename << endl;
+        exit(1);
+    }
+    madvise((void *)text, size, MADV_SEQUENTIAL);
 
-    else
-        construct_dense(file, vertices);
+    // read number of vertices and edges from the first line that is not blank
+    const char *pos = text, *end = text + size;
+    long long header[3];
+    int n = 0;
+    while (pos < end && !(n = read_line(pos, end, header)));
+
+    if (n != 2 || header[0] < 0 || header[0] > INT_MAX || header[1] < 0 || header[1] > INT_MAX)
+    {// ensure the file starts with the graph size
+
+        cout << "ERROR! Could not read vertices and edges from " << filename << endl;
+        exit(1);
+    }
+    vertices = header[0];
+    edges = header[1];
+
+    // a thread for every 1MB of edges, up to one per hardware thread
+    int threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                   (end - pos) / (1 << 20) + 1);
+
+    // parse the lines once, each thread keeping the edges it read
+    std::vector<std::vector<std::pair<int, int>>> parsed(threads);
+    read_edges(pos, end, threads, [&](int t, int v, int u) { parsed[t].emplace_back(v, u); });
+
+    if (text)
+        munmap((void *)text, size);
+
+    construct([&](auto add)
+    {
+        parallel_for(threads, threads, [&](int t)
+        {
+            for (auto &edge : parsed[t])
+                add(t, edge.first, edge.second);
+        });
+    }, threads);
 }
 
-void EfficientAdjacencyList::construct_sparse(std::ifstream &file)
+bool EfficientAdjacencyList::map(const char *filename, int fd, size_t size)
 {/*
-        This function reads the file into a map. In the map
-        the key is the vertex and the value is the set of
-        edges that vertex points to.
+        This function maps a binary adjacency file. Every row
+        is checked across all threads before the graph is used,
+        which reads the whole file once, so opening costs O(V)
+        for the rows plus O(words) for what they hold rather
+        than a few milliseconds. After that the kernel pages the
+        rows in and out as they are needed, so a graph can still
+        be larger than memory.
                                                                 */
-    sparse = true;
-    int v, u;
-    while (file >> v >> u)
-        adj_list[v].emplace(u);
+    AdjacencyFileHeader header;
+    if (size < sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, "ADJL", 4))
+        return false; // not a binary adjacency file
+
+    if (header.version != 1 || header.vertices > INT_MAX || header.edges > INT_MAX
+        || (size - sizeof(header)) / sizeof(uint64_t) < header.words
+        || size != sizeof(header) + header.vertices * sizeof(Row) + header.words * sizeof(uint64_t))
+    {// ensure the header matches the file
+
+        cout << "ERROR! " << filename << " is not a valid binary adjacency file" << endl;
+        exit(1);
+    }
+
+    mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        cout << "ERROR! Could not map " << filename << endl;
+        exit(1);
+    }
+
+    // queries jump between rows so reading ahead would only waste memory
+    madvise(mapping, size, MADV_RANDOM);
+
+    mapped = size;
+    vertices = header.vertices;
+    edges = header.edges;
+    words = (vertices + 63) / 64;
+    rows = (const Row *)((const char *)mapping + sizeof(header));
+    data = (const uint64_t *)(rows + vertices);
+    data_words = header.words;
+
+    // check every row across all threads before any is used
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int blocks = threads * 16;
+    std::atomic<bool> invalid(false);
+    parallel_for(blocks, threads, [&](int b)
+    {
+        for (int v = (long long)vertices * b / blocks; v < (long long)vertices * (b + 1) / blocks; v++)
+            if (!valid(rows[v]))
+            {
+                invalid = true;
+                return;
+            }
+    });
+
+    if (invalid)
+    {// ensure every row holds vertices of the graph and lies within the file
+
+        cout << "ERROR! " << filename << " is not a valid binary adjacency file" << endl;
+        exit(1);
+    }
+    return true;
 }
 
-void EfficientAdjacencyList::construct_dense(std::ifstream &file, double vertices)
+bool EfficientAdjacencyList::valid(const Row &row) const
 {/*
-        This function reads the file vertices times. Each
-        iteration it holds all the edges for that current
-        index. It then adds the inverse connections to 
-        the map.
+        This function checks a row read from a file. Its words
+        must lie within the file, a bitmap row must set exactly
+        degree bits and none past the last vertex, and a packed
+        list must hold vertices of the graph in strictly
+        increasing order, so reading the row never leaves the
+        mapping or gives a vertex outside the graph.
                                                                 */
-    sparse = false;
-    int v, u;
-    for (int i = 0; i < vertices; i++)
-    {// loop through each vertex
+    if (row.kind > BITMAP || row.degree < 0 || row.degree > vertices || row.width > 32)
+        return false;
+
+    int count = row.kind == ARRAY ? row.degree : vertices - row.degree;
+    size_t length = row.kind == BITMAP ? words : PackedList::words(count, row.width);
+    if (row.start > data_words || length > data_words - row.start)
+        return false;
 
-        // initialise temp set to hold edges
-        std::set<int> temp;
+    const uint64_t *word = data + row.start;
+    if (row.kind == BITMAP)
+    {
+        long long bits = 0;
+        for (size_t i = 0; i < words; i++)
+            bits += __builtin_popcountll(word[i]);
+        return bits == row.degree && !(vertices % 64 && word[words - 1] >> (vertices % 64));
+    }
 
-        //  loop until end of file
-        while (!file.eof())
-        {// read each vertex/edge
-            file >> v >> u;
-            // if v == i add u to temp set
-            if (v == i)
-                temp.emplace(u);
+    const uint64_t *packed = word + PackedList::blocks(count);
+    uint64_t previous = 0;
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t offset = 0;
+        if (row.width)
+        {
+            size_t bit = (size_t)i * row.width;
+            offset = packed[bit / 64] >> (bit % 64);
+            if (bit % 64 + row.width > 64)
+                offset |= packed[bit / 64 + 1] << (64 - bit % 64);
+            offset &= (1ull << row.width) - 1;
         }
 
-        /*
-            Loop through searching from 0 to vertices in 
-            temp. If the index is not the vertex we are at 
-            and the index is not in temp add it to the 
-            adj_list map.
+        uint64_t vertex = word[i / 128] + offset;
+        if (vertex < word[i / 128] || vertex >= (uint64_t)vertices || (i && vertex <= previous))
+            return false;
+        previous = vertex;
+    }
+    return true;
+}
+
+void EfficientAdjacencyList::write(const char *filename) const
+{/*
+        This function writes the graph as a binary adjacency
+        file: the header, the rows, then the words they point
+        into, exactly as they are laid out in memory.
                                                                 */
-        for (int j = 0; j < vertices; j++)
-            if ((j != i) && (!temp.count(j)))
-                adj_list[i].emplace(j);
-        
-        // go back to beginning of file (after vertices and edges)
-        file.seekg(4, std::ios::beg);
+    FILE *file = fopen(filename, "wb");
+    if (!file)
+    {
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
+
+    AdjacencyFileHeader header = {{'A', 'D', 'J', 'L'}, 1, (uint64_t)vertices, (uint64_t)edges,
+                                  data_words};
+    fwrite(&header, sizeof(header), 1, file);
+    if (vertices)
+        fwrite(rows, sizeof(Row), vertices, file);
+    if (data_words)
+        fwrite(data, sizeof(uint64_t), data_words, file);
+
+    if (fclose(file))
+    {
+        cout << "ERROR! Could not write " << filename << endl;
+        exit(1);
     }
 }
 
-bool EfficientAdjacencyList::connected(int v, int u)
+void EfficientAdjacencyList::transpose(const EfficientAdjacencyList &graph, bool undirected)
 {/*
-        This function performs a binary search of u on some 
-        vertex v for some sparse or dense graph. If the graph
-        is sparse it returns true if u is found. If the graph
-        is dense it returns false.
+        This function builds the graph with every edge of
+        another turned around, giving each vertex the vertices
+        with an edge to it. An undirected graph keeps the
+        edges as they were as well. The rows of graph are read
+        across all threads in place of edge lines.
                                                                 */
-    if (sparse) // graph is sparse
-        return std::binary_search(adj_list.at(v).begin(), 
-                                  adj_list.at(v).end(), u);
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int blocks = threads * 16;
+    vertices = graph.vertices;
+
+    long long total = 0;
+    construct([&](auto add)
+    {
+        parallel_for(blocks, threads, [&](int b)
+        {
+            for (int v = (long long)vertices * b / blocks; v < (long long)vertices * (b + 1) / blocks; v++)
+                for (int u : graph.get_neighbours(v))
+                {
+                    add(b, u, v);
+                    if (undirected)
+                        add(b, v, u);
+                }
+        });
+    }, threads);
 
-    else // graph is dense
-        return std::binary_search(adj_list.at(v).begin(), 
-                                  adj_list.at(v).end(), u) ? 0 : 1;
+    for (int v = 0; v < vertices; v++)
+        total += row_store[v].degree;
+    edges = std::min<long long>(total, INT_MAX);
 }
 
-std::set<int> EfficientAdjacencyList::get_neighbours(int v)
+template<typename Add>
+void EfficientAdjacencyList::read_edges(const char *begin, const char *end, int threads,
+                                        Add add) const
+{/*
+        This function splits the text into one slice per
+        thread. Each thread reads the lines that start in its
+        slice and passes every edge to add. A line that is not
+        an edge between two vertices of the graph stops the
+        program once all threads are done.
+                                                                */
+    std::vector<std::string> errors(threads);
+    parallel_for(threads, threads, [&](int t)
+    {
+        const char *pos = begin + (end - begin) * t / threads;
+        const char *stop = begin + (end - begin) * (t + 1) / threads;
+
+        // start at the first line that begins in this slice
+        if (t > 0)
+            while (pos < end && pos[-1] != '\n')
+                pos++;
+
+        long long values[3];
+        while (pos < stop)
+        {
+            const char *line = pos;
+            int n = read_line(pos, end, values);
+            if (n == 0)
+                continue; // handle blank lines
+
+            if (n != 2)
+            {
+                errors[t] = "Invalid line \"" + std::string(line, std::find(line, end, '\n')) + "\"";
+                return;
+            }
+
+            if (values[0] < 0 || values[0] >= vertices || values[1] < 0 || values[1] >= vertices)
+            {
+                errors[t] = "Edge " + std::to_string(values[0]) + " " + std::to_string(values[1])
+                            + " is not in the graph";
+                return;
+            }
+
+            add(t, (int)values[0], (int)values[1]);
+        }
+    });
+
+    for (auto &error : errors)
+        if (!error.empty())
+        {// ensure every line was an edge
+
+            cout << "ERROR! " << error << endl;
+            exit(1);
+        }
+}
+
+RowKind row_kind(long long degree, int vertices)
+{/*
+        This function picks the smallest container for a row
+        with degree neighbours. A list of vertices takes 4
+        bytes a vertex and a bitmap 8 bytes a word, so low
+        degrees are listed, degrees near the vertex count
+        list what is missing, and the rest are bitmaps.
+                                                                */
+    long long limit = 2 * (((long long)vertices + 63) / 64);
+    if (degree <= limit)
+        return ARRAY;
+    if (vertices - degree <= limit)
+        return COMPLEMENT;
+    return BITMAP;
+}
+
+template<typename Edges>
+void EfficientAdjacencyList::construct(Edges list_edges, int threads)
+{/*
+        This function walks the edges twice, from lines
+        already parsed or rows of another graph, never the text
+        itself. The first walk counts the edges leaving each
+        vertex, and rows that could still be lists get room for
+        that many vertices while the rest get a bitmap. The
+        second walk places every edge. Once repeated edges are dropped each row
+        knows its degree and is written to its final container,
+        packing the lists.
+                                                                */
+    words = (vertices + 63) / 64;
+    row_store.assign(vertices, Row({0, 0, ARRAY, 0}));
+
+    std::vector<int> counts(vertices, 0);
+    list_edges([&](int, int v, int)
+    {
+        __atomic_fetch_add(&counts[v], 1, __ATOMIC_RELAXED);
+    });
+
+    // lay out the rows the edges are read into
+    size_t listed = 0, bitmaps = 0;
+    for (int v = 0; v < vertices; v++)
+        if (counts[v] <= 2 * (long long)words)
+        {
+            row_store[v] = Row({listed, 0, ARRAY, 0});
+            listed += counts[v];
+        }
+        else
+        {
+            row_store[v] = Row({bitmaps, 0, BITMAP, 0});
+            bitmaps += words;
+        }
+
+    std::vector<int> staged(listed);
+    std::vector<size_t> next(vertices);
+    for (int v = 0; v < vertices; v++)
+        next[v] = row_store[v].start;
+    std::vector<uint64_t> bits(bitmaps, 0);
+
+    list_edges([&](int, int v, int u)
+    {
+        if (row_store[v].kind == ARRAY)
+            staged[__atomic_fetch_add(&next[v], 1, __ATOMIC_RELAXED)] = u;
+        else
+            __atomic_fetch_or(&bits[row_store[v].start + u / 64], 1ull << (u % 64), __ATOMIC_RELAXED);
+    });
+
+    // sort each row in blocks of vertices, dropping repeats to find the degree
+    int blocks = threads * 16;
+    std::vector<RowKind> chosen(vertices);
+    parallel_for(blocks, threads, [&](int b)
+    {
+        for (int v = (long long)vertices * b / blocks; v < (long long)vertices * (b + 1) / blocks; v++)
+        {
+            Row &row = row_store[v];
+            if (row.kind == ARRAY)
+            {
+                auto first = staged.begin() + row.start;
+                std::sort(first, first + counts[v]);
+                row.degree = std::unique(first, first + counts[v]) - first;
+            }
+            else
+                for (size_t i = row.start; i < row.start + words; i++)
+                    row.degree += __builtin_popcountll(bits[i]);
+            chosen[v] = row_kind(row.degree, vertices);
+        }
+    });
+
+    // the vertices of a row that ends up as a list
+    auto listing = [&](int v, std::vector<int> &list)
+    {
+        const Row &row = row_store[v];
+        list.clear();
+        if (row.kind == ARRAY)
+            list.assign(staged.begin() + row.start, staged.begin() + row.start + row.degree);
+        else
+            for (int u = 0; u < vertices; u++)
+                if ((bits[row.start + u / 64] >> (u % 64) & 1) == (chosen[v] == ARRAY))
+                    list.push_back(u);
+    };
+
+    // lay out the final containers
+    std::vector<uint8_t> widths(vertices, 0);
+    std::vector<size_t> starts(vertices + 1, 0);
+    parallel_for(blocks, threads, [&](int b)
+    {
+        std::vector<int> list;
+        for (int v = (long long)vertices * b / blocks; v < (long long)vertices * (b + 1) / blocks; v++)
+        {
+            if (chosen[v] == BITMAP)
+            {
+                starts[v + 1] = words;
+                continue;
+            }
+            listing(v, list);
+            widths[v] = PackedList::fit(list.data(), list.size());
+            starts[v + 1] = PackedList::words(list.size(), widths[v]);
+        }
+    });
+    for (int v = 0; v < vertices; v++)
+        starts[v + 1] += starts[v];
+
+    // fill them from the staged rows
+    data_store.assign(starts[vertices], 0);
+    parallel_for(blocks, threads, [&](int b)
+    {
+        std::vector<int> list;
+        for (int v = (long long)vertices * b / blocks; v < (long long)vertices * (b + 1) / blocks; v++)
+        {
+            if (chosen[v] == BITMAP)
+            {
+                std::copy(bits.begin() + row_store[v].start, bits.begin() + row_store[v].start + words,
+                          data_store.begin() + starts[v]);
+                continue;
+            }
+            listing(v, list);
+            PackedList::write(list.data(), list.size(), widths[v], data_store.data() + starts[v]);
+        }
+    });
+
+    for (int v = 0; v < vertices; v++)
+        row_store[v] = Row({starts[v], row_store[v].degree, chosen[v], widths[v]});
+
+    rows = row_store.data();
+    data = data_store.data();
+    data_words = data_store.size();
+}
+
+bool EfficientAdjacencyList::connected(int v, int u) const
+{/*
+        This function checks whether v has an edge to u. An
+        array row is binary searched for u and a complement
+        row for its absence, while a bitmap row tests bit u.
+                                                                */
+    if (v < 0 || v >= vertices || u < 0 || u >= vertices)
+        return false;
+
+    const Row &row = rows[v];
+    if (row.kind == BITMAP)
+        return data[row.start + u / 64] >> (u % 64) & 1;
+
+    return list(row).contains(u) == (row.kind == ARRAY);
+}
+
+void EfficientAdjacencyList::connected(const int *v, const int *u, size_t count,
+                                       uint64_t *results, int threads) const
+{/*
+        This function answers a batch of queries, setting bit
+        i of results when v[i] is connected to u[i]. The batch
+        is cut into blocks of 2^16 queries that the threads
+        share, each block owning its words of results. When
+        the graph has no more vertices than a block, the
+        queries of a block are grouped by vertex with a
+        counting sort, so each row is visited once and bitmap
+        rows are probed several at a time by the vector unit.
+        Otherwise few queries share a row, so they are answered
+        in order while the rows of later queries are fetched
+        ahead of time.
+                                                                */
+    const size_t block = 1 << 16;
+    BitmapProbe probe = bitmap_probe();
+    std::fill(results, results + (count + 63) / 64, 0);
+
+    auto valid = [&](size_t i)
+    { return v[i] >= 0 && v[i] < vertices && u[i] >= 0 && u[i] < vertices; };
+
+    int blocks = (count + block - 1) / block;
+    parallel_for(blocks, threads, [&](int b)
+    {
+        size_t begin = b * block, end = std::min(begin + block, count);
+        uint64_t *out = results + begin / 64;
+
+        if ((size_t)vertices > block)
+        {
+            // how far ahead the row, then the word or list it points to, is fetched
+            const size_t ahead = 16;
+            for (size_t i = begin; i < end; i++)
+            {
+                if (i + 2 * ahead < end && v[i + 2 * ahead] >= 0 && v[i + 2 * ahead] < vertices)
+                    __builtin_prefetch(&rows[v[i + 2 * ahead]]);
+                if (i + ahead < end && valid(i + ahead))
+                {
+                    const Row &row = rows[v[i + ahead]];
+                    __builtin_prefetch(&data[row.start + (row.kind == BITMAP ? u[i + ahead] / 64 : 0)]);
+                }
+                if (valid(i) && connected(v[i], u[i]))
+                    out[(i - begin) / 64] |= 1ull << ((i - begin) % 64);
+            }
+            return;
+        }
+
+        // group the queries of the block by vertex
+        std::vector<int> starts(vertices + 1, 0);
+        for (size_t i = begin; i < end; i++)
+            if (valid(i))
+                starts[v[i] + 1]++;
+        for (int w = 0; w < vertices; w++)
+            starts[w + 1] += starts[w];
+
+        std::vector<int> us(starts[vertices]);
+        std::vector<uint32_t> index(starts[vertices]);
+        std::vector<int> next(starts.begin(), starts.end() - 1);
+        for (size_t i = begin; i < end; i++)
+            if (valid(i))
+            {
+                us[next[v[i]]] = u[i];
+                index[next[v[i]]++] = i - begin;
+            }
+
+        for (int w = 0; w < vertices; w++)
+        {// answer the queries of one row together
+
+            const Row &row = rows[w];
+            int i = starts[w], j = starts[w + 1];
+            if (i == j)
+                continue;
+
+            if (row.kind == BITMAP)
+            {
+                probe(data + row.start, &us[i], &index[i], j - i, out);
+                continue;
+            }
+
+            PackedList packed = list(row);
+            for (int k = i; k < j; k++)
+                if (packed.contains(us[k]) == (row.kind == ARRAY))
+                    out[index[k] / 64] |= 1ull << (index[k] % 64);
+        }
+    });
+}
+
+Neighbours EfficientAdjacencyList::get_neighbours(int v) const
 {/*
         This function returns the neighbours (edges) of some
-        vertex v. If the graph is sparse it simply prints
-        the values of the map at v. If it is dense it loops
-        from 0 to the number of vertices and prints any value
-        not present in the values of the map at v.
+        vertex v without copying them. The range walks the
+        row of v in place, whichever container it is.
+                                                                */
+    if (v < 0 || v >= vertices)
+        return Neighbours();
+
+    const Row &row = rows[v];
+    if (row.kind == BITMAP)
+    {
+        const uint64_t *word = data + row.start;
+        return Neighbours(Neighbours::iterator(word, word, word + words),
+                          Neighbours::iterator(word, word + words, word + words));
+    }
+
+    PackedList packed = list(row);
+    if (row.kind == ARRAY)
+        return Neighbours(Neighbours::iterator(packed, 0), Neighbours::iterator(packed, packed.count));
+
+    else
+        return Neighbours(Neighbours::iterator(packed, 0, 0),
+                          Neighbours::iterator(packed, packed.count, vertices));
+}
+
+bool PackedList::contains(int u) const
+{/*
+        This function finds the last block starting at or
+        before u by binary searching the first vertices, then
+        binary searches that block for u.
+                                                                */
+    int low = 0, high = blocks(count);
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if ((int)bases[mid] <= u)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (!low)
+        return false;
+
+    int first = (low - 1) * 128, last = std::min(count, low * 128);
+    while (first < last)
+    {
+        int mid = (first + last) / 2, vertex = (*this)[mid];
+        if (vertex == u)
+            return true;
+        if (vertex < u)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return false;
+}
+
+int PackedList::fit(const int *values, int count)
+{// the bits needed by the largest offset from the first vertex of a block
+
+    uint64_t largest = 0;
+    for (int i = 0; i < count; i++)
+        largest = std::max<uint64_t>(largest, values[i] - values[i / 128 * 128]);
+    return largest ? 64 - __builtin_clzll(largest) : 0;
+}
+
+void PackedList::write(const int *values, int count, int width, uint64_t *out)
+{// packs a sorted list into words that start out zero
+
+    uint64_t *packed = out + blocks(count);
+    for (int i = 0; i < count; i += 128)
+        out[i / 128] = values[i];
+
+    for (int i = 0; i < count && width; i++)
+    {
+        uint64_t offset = values[i] - values[i / 128 * 128];
+        size_t bit = (size_t)i * width;
+        packed[bit / 64] |= offset << (bit % 64);
+        if (bit % 64 + width > 64)
+            packed[bit / 64 + 1] |= offset >> (64 - bit % 64);
+    }
+}
+
+int EfficientAdjacencyList::degree(int v) const
+{// returns the number of neighbours of v, which every row keeps
+
+    if (v < 0 || v >= vertices)
+        return 0;
+    return rows[v].degree;
+}
+
+bool EfficientAdjacencyList::meets(int v, const uint64_t *set) const
+{/*
+        This function looks for a neighbour of v in a set of
+        vertices kept as a bitmap. A bitmap row is ANDed with
+        the set eight words at a time, which the compiler can
+        vectorise, and other rows test the bit of each
+        neighbour until one is in the set.
                                                                 */
-    std::set<int> neighbours;
+    const Row &row = rows[v];
+    if (row.kind == BITMAP)
+    {
+        const uint64_t *word = data + row.start;
+        size_t i = 0;
+        for (; i + 8 <= words; i += 8)
+        {
+            uint64_t any = 0;
+            for (int k = 0; k < 8; k++)
+                any |= word[i + k] & set[i + k];
+            if (any)
+                return true;
+        }
+        for (; i < words; i++)
+            if (word[i] & set[i])
+                return true;
+        return false;
+    }
+
+    for (int u : get_neighbours(v))
+        if (set[u / 64] >> (u % 64) & 1)
+            return true;
+    return false;
+}
 
-    if (sparse)
-    {// graph is sparse
+ConcurrentAdjacencyList::ConcurrentAdjacencyList(const EfficientAdjacencyList &graph)
+    : vertices(graph.size()), words((graph.size() + 63) / 64),
+      rows(new std::atomic<const Version *>[graph.size()]), slots(new ReaderSlot[readers])
+{// copies every row of the graph into a version of its own, across all threads
 
-        auto it = adj_list.at(v);
-        for (auto i : it)
-            neighbours.emplace(i);
+    int threads = std::max(1u, std::thread::hardware_concurrency());
+    int blocks = threads * 16;
+    parallel_for(blocks, threads, [&](int b)
+    {
+        std::vector<int> list;
+        for (int v = (long long)vertices * b / blocks; v < (long long)vertices * (b + 1) / blocks; v++)
+        {
+            list.clear();
+            for (int u : graph.get_neighbours(v))
+                list.push_back(u);
+            rows[v].store(build(list), std::memory_order_relaxed);
+        }
+    });
+}
+
+ConcurrentAdjacencyList::~ConcurrentAdjacencyList()
+{// no reader may still be running, so every version can go
+
+    for (int v = 0; v < vertices; v++)
+        delete rows[v].load();
+    for (auto &version : retired)
+        delete version.first;
+}
+
+int ConcurrentAdjacencyList::reader_slot()
+{/*
+        This function gives each reading thread a slot of its
+        own, claimed with a compare and swap rather than a lock
+        and handed back when the thread exits.
+                                                                */
+    static std::atomic<bool> claimed[readers];
+    struct Claim
+    {
+        int slot = -1;
+        ~Claim() { if (slot >= 0) claimed[slot].store(false, std::memory_order_release); }
+    };
+    thread_local Claim claim;
+
+    for (int s = 0; claim.slot < 0 && s < readers; s++)
+    {
+        bool free = false;
+        if (claimed[s].compare_exchange_strong(free, true))
+            claim.slot = s;
     }
 
+    if (claim.slot < 0)
+    {// ensure there are few enough readers
+
+        cout << "ERROR! More than " << readers << " threads are reading a graph" << endl;
+        exit(1);
+    }
+    return claim.slot;
+}
+
+const ConcurrentAdjacencyList::Version *ConcurrentAdjacencyList::build(
+    const std::vector<int> &neighbours) const
+{/*
+        This function decides the container of a row again
+        from its new degree, so a row that fills up becomes a
+        bitmap and one that empties becomes a list, then
+        writes the neighbours into it.
+                                                                */
+    Version *row = new Version;
+    row->degree = neighbours.size();
+    row->kind = row_kind(row->degree, vertices);
+    row->width = 0;
+
+    if (row->kind == BITMAP)
+    {
+        row->data.assign(words, 0);
+        for (int u : neighbours)
+            row->data[u / 64] |= 1ull << (u % 64);
+        return row;
+    }
+
+    std::vector<int> missing;
+    if (row->kind == COMPLEMENT)
+        for (int u = 0, i = 0; u < vertices; u++)
+        {
+            if (i < row->degree && neighbours[i] == u)
+                i++;
+            else
+                missing.push_back(u);
+        }
+
+    const std::vector<int> &list = row->kind == ARRAY ? neighbours : missing;
+    row->width = PackedList::fit(list.data(), list.size());
+    row->data.assign(PackedList::words(list.size(), row->width), 0);
+    PackedList::write(list.data(), list.size(), row->width, row->data.data());
+    return row;
+}
+
+Neighbours ConcurrentAdjacencyList::range(const Version &row) const
+{// the neighbours of a version, walked in place like EfficientAdjacencyList::get_neighbours
+
+    if (row.kind == BITMAP)
+    {
+        const uint64_t *word = row.data.data();
+        return Neighbours(Neighbours::iterator(word, word, word + words),
+                          Neighbours::iterator(word, word + words, word + words));
+    }
+
+    PackedList packed(row.data.data(), row.kind == ARRAY ? row.degree : vertices - row.degree,
+                      row.width);
+    if (row.kind == ARRAY)
+        return Neighbours(Neighbours::iterator(packed, 0), Neighbours::iterator(packed, packed.count));
+
     else
-    {// graph is dense
+        return Neighbours(Neighbours::iterator(packed, 0, 0),
+                          Neighbours::iterator(packed, packed.count, vertices));
+}
+
+size_t ConcurrentAdjacencyList::apply(const EdgeEdit *edits, size_t count)
+{/*
+        This function applies a batch of edits. The edits are
+        grouped by row, keeping their order so the last edit
+        of an edge wins, and each row that changes is merged
+        with its edits into a new version and swapped in. The
+        replaced versions are retired in the current epoch,
+        then the epoch moves on: a reader that starts after
+        that can only see the new versions.
+                                                                */
+    std::lock_guard<std::mutex> lock(writer);
+
+    std::vector<EdgeEdit> sorted;
+    for (size_t i = 0; i < count; i++)
+        if (edits[i].v >= 0 && edits[i].v < vertices && edits[i].u >= 0 && edits[i].u < vertices)
+            sorted.push_back(edits[i]);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const EdgeEdit &a, const EdgeEdit &b)
+    { return a.v < b.v || (a.v == b.v && a.u < b.u); });
+
+    uint64_t now = epoch.load();
+    size_t changed = 0;
+    std::vector<int> current, next;
+    for (size_t i = 0, j; i < sorted.size(); i = j)
+    {
+        int v = sorted[i].v;
+        const Version *old = rows[v].load();
+        current.clear();
+        for (int u : range(*old))
+            current.push_back(u);
+
+        // merge the row with the last edit of each edge
+        next.clear();
+        size_t k = 0;
+        for (j = i; j < sorted.size() && sorted[j].v == v; j++)
+        {
+            if (j + 1 < sorted.size() && sorted[j + 1].v == v && sorted[j + 1].u == sorted[j].u)
+                continue;
+
+            int u = sorted[j].u;
+            for (; k < current.size() && current[k] < u; k++)
+                next.push_back(current[k]);
+            if (k < current.size() && current[k] == u)
+                k++;
+            if (!sorted[j].erase)
+                next.push_back(u);
+        }
+        next.insert(next.end(), current.begin() + k, current.end());
+
+        if (next == current)
+            continue;
+
+        rows[v].store(build(next));
+        retired.push_back(std::make_pair(old, now));
+        changed++;
+    }
+
+    epoch.fetch_add(1);
+    reclaim();
+    return changed;
+}
+
+void ConcurrentAdjacencyList::reclaim()
+{/*
+        This function finds the oldest epoch a reader is still
+        in. A version replaced before then was swapped out
+        before any running reader started, so none holds it.
+                                                                */
+    uint64_t oldest = epoch.load();
+    for (int s = 0; s < readers; s++)
+    {
+        uint64_t started = slots[s].epoch.load();
+        if (started && started < oldest)
+            oldest = started;
+    }
+
+    auto freed = std::partition(retired.begin(), retired.end(),
+                                [&](const std::pair<const Version *, uint64_t> &version)
+                                { return version.second >= oldest; });
+    for (auto it = freed; it != retired.end(); ++it)
+        delete it->first;
+    retired.erase(freed, retired.end());
+}
+
+bool ConcurrentAdjacencyList::connected(int v, int u) const
+{// checks the version of row v current when the read starts, as EfficientAdjacencyList does
+
+    if (v < 0 || v >= vertices || u < 0 || u >= vertices)
+        return false;
+
+    ReadGuard guard(*this);
+    const Version &row = *rows[v].load();
+    if (row.kind == BITMAP)
+        return row.data[u / 64] >> (u % 64) & 1;
+
+    PackedList packed(row.data.data(), row.kind == ARRAY ? row.degree : vertices - row.degree,
+                      row.width);
+    return packed.contains(u) == (row.kind == ARRAY);
+}
+
+int ConcurrentAdjacencyList::degree(int v) const
+{// returns the number of neighbours of v
+
+    if (v < 0 || v >= vertices)
+        return 0;
+    ReadGuard guard(*this);
+    return rows[v].load()->degree;
+}
+
+BreadthFirstSearch::BreadthFirstSearch(const EfficientAdjacencyList &graph,
+                                       const EfficientAdjacencyList &reversed, int threads)
+    : graph(graph), reversed(reversed), threads(threads), visited((graph.size() + 63) / 64),
+      frontier(visited.size()), next(visited.size())
+{
+}
+
+int BreadthFirstSearch::distances(int source, std::vector<int> &depth)
+{// a single search over a graph where nothing has been visited
+
+    depth.assign(graph.size(), -1);
+    std::fill(visited.begin(), visited.end(), 0);
+    unexplored = 0;
+    for (int v = 0; v < graph.size(); v++)
+        unexplored += graph.degree(v);
+
+    if (source < 0 || source >= graph.size())
+        return 0;
+    return search(source, depth.data(), nullptr);
+}
+
+int BreadthFirstSearch::components(std::vector<int> &component)
+{/*
+        This function searches from every vertex no earlier
+        search reached, in order, so each component is labelled
+        with its smallest vertex. The vertices visited stay
+        visited, so every search only walks its own component.
+                                                                */
+    component.assign(graph.size(), -1);
+    std::fill(visited.begin(), visited.end(), 0);
+    unexplored = 0;
+    for (int v = 0; v < graph.size(); v++)
+        unexplored += graph.degree(v);
+
+    int count = 0;
+    for (int v = 0; v < graph.size(); v++)
+        if (!(visited[v / 64] >> (v % 64) & 1))
+        {
+            search(v, nullptr, component.data());
+            count++;
+        }
+    return count;
+}
+
+int BreadthFirstSearch::search(int source, int *depth, int *root)
+{/*
+        This function runs the search a level at a time. It
+        goes bottom up while the edges leaving the frontier
+        are more than 1/15 of those left unexplored, and more
+        than the words a bottom up step scans, and back top
+        down once the frontier shrinks below 1/18 of the
+        vertices, moving the frontier between a list and a
+        bitmap as it switches.
+                                                                */
+    const long long alpha = 15, beta = 18;
+    int vertices = graph.size();
+
+    visited[source / 64] |= 1ull << (source % 64);
+    if (depth)
+        depth[source] = 0;
+    if (root)
+        root[source] = source;
+    long long scout = graph.degree(source);
+    unexplored -= scout;
+    queue.assign(1, source);
+
+    int level = 0;
+    size_t found = 1;
+    bool bottom = false;
+    while (found)
+    {
+        level++;
+        if (!bottom && scout > std::max(unexplored / alpha, (long long)visited.size()))
+        {// switch to bottom up
 
-        auto it = adj_list.at(v);
-        for (int i = 0; i <= adj_list.size(); i++)       
-            if (!it.count(i) && i != v)
-                neighbours.emplace(i);
+            std::fill(frontier.begin(), frontier.end(), 0);
+            for (int v : queue)
+                frontier[v / 64] |= 1ull << (v % 64);
+            bottom = true;
+        }
+
+        if (!bottom)
+        {
+            scout = top_down(level, depth, root, source);
+            found = queue.size();
+            continue;
+        }
+
+        size_t before = found;
+        scout = bottom_up(level, depth, root, source, found);
+        std::swap(frontier, next);
+        if (found < before && (long long)found < vertices / beta)
+        {// switch to top down
+
+            queue.clear();
+            for (size_t i = 0; i < frontier.size(); i++)
+                for (uint64_t bits = frontier[i]; bits; bits &= bits - 1)
+                    queue.push_back(i * 64 + __builtin_ctzll(bits));
+            bottom = false;
+        }
+    }
+    return level;
+}
+
+long long BreadthFirstSearch::top_down(int level, int *depth, int *root, int source)
+{/*
+        This function follows the edges out of each vertex of
+        the frontier, the threads sharing the list. A vertex
+        belongs to the thread whose atomic or sets its visited
+        bit first.
+                                                                */
+    int tasks = std::min<size_t>(threads * 16, queue.size() / 1024 + 1);
+    std::vector<std::vector<int>> found(tasks);
+    std::vector<long long> scout(tasks, 0);
+
+    parallel_for(tasks, threads, [&](int t)
+    {
+        for (size_t i = queue.size() * t / tasks; i < queue.size() * (t + 1) / tasks; i++)
+            for (int u : graph.get_neighbours(queue[i]))
+            {
+                uint64_t bit = 1ull << (u % 64);
+                if (__atomic_load_n(&visited[u / 64], __ATOMIC_RELAXED) & bit
+                    || __atomic_fetch_or(&visited[u / 64], bit, __ATOMIC_RELAXED) & bit)
+                    continue;
+
+                found[t].push_back(u);
+                scout[t] += graph.degree(u);
+                if (depth)
+                    depth[u] = level;
+                if (root)
+                    root[u] = source;
+            }
+    });
+
+    long long edges = 0;
+    queue.clear();
+    for (int t = 0; t < tasks; t++)
+    {
+        queue.insert(queue.end(), found[t].begin(), found[t].end());
+        edges += scout[t];
     }
-    return neighbours;
+    unexplored -= edges;
+    return edges;
+}
+
+long long BreadthFirstSearch::bottom_up(int level, int *depth, int *root, int source,
+                                        size_t &found)
+{/*
+        This function checks every unvisited vertex for a
+        neighbour in the frontier through the reversed graph.
+        The threads share the visited bitmap a word at a time,
+        so each word has one writer and needs no atomics.
+                                                                */
+    int vertices = graph.size();
+    size_t words = visited.size();
+    int blocks = std::min<size_t>(threads * 16, words / 256 + 1);
+    std::vector<size_t> count(blocks, 0);
+    std::vector<long long> scout(blocks, 0);
+
+    parallel_for(blocks, threads, [&](int b)
+    {
+        for (size_t i = words * b / blocks; i < words * (b + 1) / blocks; i++)
+        {
+            uint64_t unseen = ~visited[i], hits = 0;
+            if (i == words - 1 && vertices % 64)
+                unseen &= (1ull << (vertices % 64)) - 1;
+
+            for (; unseen; unseen &= unseen - 1)
+            {
+                int w = i * 64 + __builtin_ctzll(unseen);
+                if (!reversed.meets(w, frontier.data()))
+                    continue;
+
+                hits |= unseen & -unseen;
+                scout[b] += graph.degree(w);
+                if (depth)
+                    depth[w] = level;
+                if (root)
+                    root[w] = source;
+            }
+
+            next[i] = hits;
+            visited[i] |= hits;
+            count[b] += __builtin_popcountll(hits);
+        }
+    });
+
+    long long edges = 0;
+    found = 0;
+    for (int b = 0; b < blocks; b++)
+    {
+        found += count[b];
+        edges += scout[b];
+    }
+    unexplored -= edges;
+    return edges;
 }
 
 int main(int argc, char** argv)
@@ -167,26 +1507,408 @@ int main(int argc, char** argv)
         exit(1);
     }
 
+    // --queries answers the "v u" pairs in a file as one batch and
+    // --random answers a batch of n random pairs
+    bool queries = argc > 2 && !strcmp(argv[2], "--queries");
+    bool random = argc > 2 && !strcmp(argv[2], "--random");
+    // --convert writes the graph to a binary adjacency file
+    bool convert = argc > 2 && !strcmp(argv[2], "--convert");
+    // --update applies batches of edge edits while other threads read the graph
+    bool update = argc > 2 && !strcmp(argv[2], "--update");
+    // --bfs finds the distance of every vertex from a source and --components
+    // the weakly connected components
+    bool bfs = argc > 2 && !strcmp(argv[2], "--bfs");
+    bool components = argc > 2 && !strcmp(argv[2], "--components");
+
+    if ((queries || random || convert || update || bfs) && argc < 4)
+    {// ensure the query file or count is passed
+
+        cout << "ERROR! Expected " << (random ? "query count" : bfs ? "source" : "filename")
+             << " after " << argv[2] << endl;
+        exit(1);
+    }
+
     // create object
     EfficientAdjacencyList graph;
 
     // load graph into object
     graph.determine(argv[1]);
 
+    if (convert)
+    {// save the rows as a binary adjacency file
+
+        graph.write(argv[3]);
+        cout << "Wrote " << graph.size() << " rows to " << argv[3] << endl;
+        return 0;
+    }
+
+    if (bfs || components)
+    {// search across every thread, bottom up through the reversed graph
+
+        int threads = std::max(1u, std::thread::hardware_concurrency());
+        EfficientAdjacencyList reversed;
+        reversed.transpose(graph, components);
+
+        std::vector<int> found;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (bfs)
+        {
+            int source = atoi(argv[3]);
+            if (source < 0 || source >= graph.size())
+            {// ensure the search starts in the graph
+
+                cout << "ERROR! Source " << argv[3] << " is not a vertex of the graph" << endl;
+                exit(1);
+            }
+
+            BreadthFirstSearch search(graph, reversed, threads);
+            int levels = search.distances(source, found);
+            auto stop = std::chrono::high_resolution_clock::now();
+
+            std::vector<int> width(levels, 0);
+            for (int depth : found)
+                if (depth >= 0)
+                    width[depth]++;
+            for (int level = 0; level < levels; level++)
+                cout << "Level " << level << ": " << width[level] << " vertices" << endl;
+            cout << "Reached " << std::count_if(found.begin(), found.end(), [](int depth)
+                                                 { return depth >= 0; })
+                 << " of " << graph.size() << " vertices from " << source << endl
+                 << "Search took " << std::chrono::duration_cast<std::chrono::microseconds>
+                                      (stop - start).count() << " microseconds" << endl;
+        }
+        else
+        {// the undirected graph is its own reverse
+
+            BreadthFirstSearch search(reversed, reversed, threads);
+            int count = search.components(found);
+            auto stop = std::chrono::high_resolution_clock::now();
+
+            std::vector<int> sizes(graph.size(), 0);
+            for (int root : found)
+                sizes[root]++;
+            cout << "Found " << count << " weakly connected components, the largest with "
+                 << (count ? *std::max_element(sizes.begin(), sizes.end()) : 0) << " vertices" << endl
+                 << "Search took " << std::chrono::duration_cast<std::chrono::microseconds>
+                                      (stop - start).count() << " microseconds" << endl;
+        }
+        return 0;
+    }
+
+    if (queries || random)
+    {// answer a batch of connectivity queries across every thread
+
+        std::vector<int> v, u;
+        if (queries)
+            readqueries(argv[3], v, u);
+        else
+        {
+            std::mt19937 generator(1);
+            std::uniform_int_distribution<int> vertex(0, std::max(graph.size() - 1, 0));
+            v.resize(std::max(atoll(argv[3]), 0LL));
+            u.resize(v.size());
+            for (size_t i = 0; i < v.size(); i++)
+            {
+                v[i] = vertex(generator);
+                u[i] = vertex(generator);
+            }
+        }
+
+        std::vector<uint64_t> results((v.size() + 63) / 64);
+        auto start = std::chrono::high_resolution_clock::now();
+        graph.connected(v.data(), u.data(), v.size(), results.data(),
+                        std::max(1u, std::thread::hardware_concurrency()));
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast
+                        <std::chrono::microseconds> (stop - start).count();
+
+        size_t found = 0;
+        for (uint64_t word : results)
+            found += __builtin_popcountll(word);
+
+        cout << "Answered " << v.size() << " queries, " << found << " connected" << endl
+             << "Queries took " << duration << " microseconds ("
+             << (long long)(v.size() / std::max(duration / 1e6, 1e-6)) << " queries per second)" << endl;
+        return 0;
+    }
+
     // Set u and v for below tests
     int v = 4, u = 6;
 
+    if (update)
+    {// edit a concurrent copy of the graph, then run the tests on the result
+
+        ConcurrentAdjacencyList edited(graph);
+        run_updates(argv[3], edited);
+
+        cout << "Testing: Is vertex " << v << " connected to vertex " << u << "?" << endl;
+        cout << (edited.connected(v, u) == 1 ? "True" : "False") << endl;
+
+        cout << "Testing: Produce a list of all vertices connected to " << v << "..." << endl;
+        edited.neighbours(v, [](int it) { cout << it << " "; });
+        cout << endl;
+
+        cout << "Testing: Count the vertices connected to " << v << "..." << endl;
+        cout << edited.degree(v) << endl;
+        return 0;
+    }
+
     // Is vertex v vonnected to vertex u
     cout << "Testing: Is vertex " << v << " connected to vertex " << u << "?" << endl;
     cout << (graph.connected(v, u) == 1 ? "True" : "False") << endl;
-    
+
     // Produce a list of all vertices connected to v
     cout << "Testing: Produce a list of all vertices connected to " << v << "..." << endl;
-    std::set<int> neighbours = graph.get_neighbours(v);
-
-    for (auto it : neighbours)
+    for (int it : graph.get_neighbours(v))
         cout << it << " ";
     cout << endl;
 
+    // Count the vertices connected to v
+    cout << "Testing: Count the vertices connected to " << v << "..." << endl;
+    cout << graph.degree(v) << endl;
+
     return 0;
-}
\ No newline at end of file
+}
+
+int read_line(const char *&pos, const char *end, long long *values)
+{/*
+        This function parses the integers on the line at pos,
+        storing up to three in values, and moves pos to the
+        start of the next line. It returns how many integers
+        the line holds, or -1 if it holds anything else.
+                                                                */
+    int n = 0;
+    while (pos < end && *pos != '\n')
+    {
+        if (*pos == ' ' || *pos == '\t' || *pos == '\r')
+        {
+            pos++;
+            continue;
+        }
+
+        bool negative = *pos == '-';
+        pos += negative || *pos == '+';
+        if (n == 3 || pos == end || *pos < '0' || *pos > '9')
+        {// not an integer, skip the rest of the line
+
+            n = -1;
+            pos = std::find(pos, end, '\n');
+            break;
+        }
+
+        // stop growing the value once it is out of range
+        long long value = 0;
+        for (; pos < end && *pos >= '0' && *pos <= '9'; pos++)
+            if (value <= INT_MAX)
+                value = value * 10 + (*pos - '0');
+        values[n++] = negative ? -value : value;
+    }
+
+    // move past the new line
+    if (pos < end)
+        pos++;
+    return n;
+}
+
+template<typename Task>
+void parallel_for(int tasks, int threads, Task task)
+{/*
+        This function runs task(0) to task(tasks - 1) on a
+        pool of threads. Each thread takes the next task index
+        until none are left.
+                                                                */
+    std::atomic<int> next(0);
+    auto worker = [&]()
+    {
+        for (int i = next++; i < tasks; i = next++)
+            task(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < std::min(tasks, threads); t++)
+        pool.push_back(std::thread(worker));
+
+    worker();
+    for (auto &thread : pool)
+        thread.join();
+}
+
+void readqueries(const char *filename, std::vector<int> &v, std::vector<int> &u)
+{/*
+        This function loads a query file, one "v u" pair to a
+        line, in the same way as the edges of a graph.
+                                                                */
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) < 0)
+    {// ensure the file can be read
+
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
+
+    size_t size = info.st_size;
+    const char *text = size ? (const char *)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)
+                            : nullptr;
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        cout << "ERROR! Could not map " << filename << endl;
+        exit(1);
+    }
+    madvise((void *)text, size, MADV_SEQUENTIAL);
+
+    const char *pos = text, *end = text + size;
+    long long values[3];
+    while (pos < end)
+    {
+        const char *line = pos;
+        int n = read_line(pos, end, values);
+        if (n == 0)
+            continue; // handle blank lines
+
+        if (n != 2 || values[0] < INT_MIN || values[0] > INT_MAX
+            || values[1] < INT_MIN || values[1] > INT_MAX)
+        {// ensure every line is a pair of vertices
+
+            cout << "ERROR! Invalid query \"" << std::string(line, std::find(line, end, '\n'))
+                 << "\" in " << filename << endl;
+            exit(1);
+        }
+        v.push_back(values[0]);
+        u.push_back(values[1]);
+    }
+
+    if (text)
+        munmap((void *)text, size);
+}
+
+void run_updates(const char *filename, ConcurrentAdjacencyList &graph)
+{/*
+        This function applies an update file in batches. "+ v u"
+        adds an edge and "- v u" erases it, and a line holding
+        only "=" ends a batch, as does the end of the file. The
+        batches are applied while a reader on every other
+        hardware thread asks random connectivity questions, and
+        the number of rows each batch changed is printed.
+                                                                */
+    std::ifstream file(filename);
+    if (!file)
+    {
+        cout << "ERROR! Could not open " << filename << endl;
+        exit(1);
+    }
+
+    std::vector<std::vector<EdgeEdit>> batches(1);
+    std::string line;
+    while (std::getline(file, line))
+    {// read updates inputed as op v u
+
+        std::stringstream linestream(line);
+        std::string op;
+        EdgeEdit edit = {0, 0, false};
+        if (!(linestream >> op))
+            continue;
+
+        if (op == "=")
+        {
+            batches.push_back(std::vector<EdgeEdit>());
+            continue;
+        }
+
+        edit.erase = op == "-";
+        if ((op != "+" && op != "-") || !(linestream >> edit.v >> edit.u)
+            || edit.v < 0 || edit.v >= graph.size() || edit.u < 0 || edit.u >= graph.size())
+        {// ensure the update is valid
+
+            cout << "ERROR! Invalid update \"" << line << "\" in " << filename << endl;
+            exit(1);
+        }
+
+        batches.back().push_back(edit);
+    }
+    if (batches.back().empty())
+        batches.pop_back();
+
+    std::atomic<bool> done(false);
+    std::atomic<long long> answered(0);
+    std::vector<std::thread> pool;
+    for (int t = 1; t < (int)std::max(2u, std::thread::hardware_concurrency()); t++)
+        pool.push_back(std::thread([&, t]()
+        {
+            std::mt19937 generator(t);
+            std::uniform_int_distribution<int> vertex(0, std::max(graph.size() - 1, 0));
+            long long count = 0;
+            for (; !done.load(std::memory_order_relaxed); count++)
+                graph.connected(vertex(generator), vertex(generator));
+            answered += count;
+        }));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t b = 0; b < batches.size(); b++)
+    {
+        size_t changed = graph.apply(batches[b].data(), batches[b].size());
+        cout << "Batch " << b + 1 << " changed " << changed << " rows" << endl;
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+
+    done = true;
+    for (auto &thread : pool)
+        thread.join();
+
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds> (stop - start).count();
+    cout << "Updates took " << duration << " microseconds while readers answered "
+         << answered << " queries" << endl;
+}
+
+BitmapProbe bitmap_probe()
+{// picks the widest bitmap probe the processor supports
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return probe_avx2;
+    return probe_scalar;
+}
+
+void probe_scalar(const uint64_t *row, const int *us, const uint32_t *index, size_t count,
+                  uint64_t *results)
+{
+    for (size_t i = 0; i < count; i++)
+        if (row[us[i] / 64] >> (us[i] % 64) & 1)
+            results[index[i] / 64] |= 1ull << (index[i] % 64);
+}
+
+__attribute__((target("avx2")))
+void probe_avx2(const uint64_t *row, const int *us, const uint32_t *index, size_t count,
+                uint64_t *results)
+{/*
+        Probes eight vertices at a time: the words holding
+        their bits are gathered, each shifted down by its own
+        bit position, and the low bits collected into a mask
+        of the probes that hit.
+                                                                */
+    const __m128i low = _mm_set1_epi32(63);
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        int mask = 0;
+        for (int half = 0; half < 2; half++)
+        {
+            __m128i vertex = _mm_loadu_si128((const __m128i *)(us + i + 4 * half));
+            __m256i words = _mm256_i32gather_epi64((const long long *)row,
+                                                   _mm_srli_epi32(vertex, 6), 8);
+            __m256i shift = _mm256_cvtepi32_epi64(_mm_and_si128(vertex, low));
+            __m256i hit = _mm256_slli_epi64(_mm256_srlv_epi64(words, shift), 63);
+            mask |= _mm256_movemask_pd(_mm256_castsi256_pd(hit)) << (4 * half);
+        }
+
+        for (; mask; mask &= mask - 1)
+        {
+            uint32_t k = index[i + __builtin_ctz(mask)];
+            results[k / 64] |= 1ull << (k % 64);
+        }
+    }
+
+    probe_scalar(row, us + i, index + i, count - i, results);
+}
@@ -1,5 +1,12 @@
 #include <iostream>
 #include <array>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
 
 using std::cout;
 using std::endl;
@@ -87,8 +94,198 @@ void FastList<N>::clear()
     list_length = 0;
 }
 
-int main()
+/*
+    The same list for a number of items only known at run time. The
+    index and value arrays are mapped from the operating system rather
+    than kept inline, so millions of items do not overflow the stack,
+    and can be backed by huge pages. Mapped pages start out zero and
+    are only touched once used, so building the list costs nothing
+    whatever its size. Instead of setting every index to -1, an item
+    is in the list when its index points inside the list back at it,
+    which also lets clear simply forget the list.
+                                                                    */
+class DynamicFastList
 {
+    int *index = nullptr, *value = nullptr;
+    size_t bytes = 0; // the mapped size of each array
+    int capacity = 0;
+
+    // keep track of the length of the list compared to capacity
+    int list_length = 0;
+
+    // map a zeroed array of capacity ints, aligned to a page
+    int* allocate(bool huge_pages);
+
+public:
+    // map room for items 0 to capacity - 1, optionally on huge pages
+    explicit DynamicFastList(int capacity, bool huge_pages = false);
+    ~DynamicFastList();
+    DynamicFastList(const DynamicFastList&) = delete;
+    DynamicFastList& operator=(const DynamicFastList&) = delete;
+
+    // add items to the list
+    void add(int item);
+
+    // remove items from the list
+    void remove(int item);
+
+    // clear the list
+    void clear() { list_length = 0; }
+
+    // return if the item is in the list
+    bool contains(int item)
+    {
+        if (item < 0 || item >= capacity)
+            return false;
+        int it = index[item];
+        return it < list_length && value[it] == item;
+    }
+
+    // overload indexing operator
+    int operator[](int it) { return value[it]; }
+
+    // return the length of the list - used for test cases
+    int length() { return list_length; }
+};
+
+DynamicFastList::DynamicFastList(int capacity, bool huge_pages) : capacity(capacity)
+{
+    if (capacity < 0)
+    {// ensure the size makes sense
+        cout << "ERROR! " << capacity << " must be >= 0" << endl;
+        exit(1);
+    }
+
+    index = allocate(huge_pages);
+    value = allocate(huge_pages);
+}
+
+DynamicFastList::~DynamicFastList()
+{
+    munmap(index, bytes);
+    munmap(value, bytes);
+}
+
+int* DynamicFastList::allocate(bool huge_pages)
+{
+    /*
+        Huge pages are 2MB, so the array is rounded up to that size
+        and the kernel is asked to back it with them where it can.
+        Either way the pages are zero until first written.
+                                                                    */
+    size_t page = huge_pages ? 2 << 20 : sysconf(_SC_PAGESIZE);
+    bytes = ((size_t)capacity * sizeof(int) + page - 1) / page * page;
+    if (!bytes)
+        bytes = page;
+
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {// ensure the arrays fit in memory
+        cout << "ERROR! Could not allocate a list of " << capacity << " items" << endl;
+        exit(1);
+    }
+
+#ifdef MADV_HUGEPAGE
+    if (huge_pages)
+        madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+    return (int*)memory;
+}
+
+void DynamicFastList::add(int item)
+{
+    // invalid item
+    if (item >= capacity || item < 0)
+        cout << "ERROR! " << item << " must be >= 0 and < "<< capacity << endl;
+
+    // item is already in list
+    else if(contains(item))
+        cout << "ERROR! " << item << " is already in list" << endl;
+
+    else
+    {// otherwise add it to the list
+        index[item] = list_length;
+        value[list_length++] = item;
+    }
+}
+
+void DynamicFastList::remove(int item)
+{
+    if(!contains(item))
+    {// check if item is present
+        std::cout << item << " is not present in list" << endl;
+        exit(1);
+    }
+
+    // replace item with last item in value array
+    int it = index[item];
+    value[it] = value[list_length - 1];
+
+    // update the index of the moved value
+    index[value[it]] = it;
+    list_length--;
+}
+
+template<typename List>
+void time_list(List& list, int n)
+{
+    /*
+        Adds every third item below n, removes every other one of
+        those, checks membership of every item and clears the list,
+        printing what is left after each step. Both lists share this
+        interface, so either can be timed.
+                                                                    */
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int item = 0; item < n; item += 3)
+        list.add(item);
+    cout << "Added " << list.length() << " items" << endl;
+
+    for (int item = 0; item < n; item += 6)
+        list.remove(item);
+    cout << "Removed items, " << list.length() << " left" << endl;
+
+    int found = 0;
+    for (int item = 0; item < n; item++)
+        found += list.contains(item);
+    cout << "Found " << found << " items in the list" << endl;
+
+    list.clear();
+    cout << "Cleared the list, " << list.length() << " left" << endl;
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    cout << "Took " << std::chrono::duration_cast<std::chrono::microseconds>
+                       (stop - start).count() << " microseconds" << endl;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+    {// a list sized at run time: n [--huge]
+
+        char* end;
+        errno = 0;
+        long size = strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end || errno == ERANGE || size < 0 || size > INT_MAX)
+        {// ensure the size is a whole number the list can hold
+
+            cout << "ERROR! Expected a list size from 0 to " << INT_MAX << " but got \""
+                 << argv[1] << "\"" << endl;
+            exit(1);
+        }
+
+        int n = size;
+        bool huge = argc > 2 && !strcmp(argv[2], "--huge");
+
+        auto start = std::chrono::high_resolution_clock::now();
+        DynamicFastList list(n, huge);
+        auto stop = std::chrono::high_resolution_clock::now();
+        cout << "Built a list of " << n << " items in " << std::chrono::duration_cast
+                <std::chrono::microseconds>(stop - start).count() << " microseconds" << endl;
+
+        time_list(list, n);
+        return 0;
+    }
 
     /* 
         This is the upper bound given in the problem statement.